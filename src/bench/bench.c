@@ -0,0 +1,522 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#define BENCH_MAX_CONNECTIONS 1024
+#define BENCH_NAME_SIZE 32
+
+typedef enum BenchOp
+{
+    BENCH_OP_LOOKUP = 0,
+    BENCH_OP_READ,
+    BENCH_OP_WRITE,
+    BENCH_OP_LIST,
+    BENCH_OP_CREATE,
+    BENCH_OPS_COUNT,
+} BenchOp;
+
+static const char *op_names[BENCH_OPS_COUNT] = {
+    [BENCH_OP_LOOKUP] = "lookup",
+    [BENCH_OP_READ] = "read",
+    [BENCH_OP_WRITE] = "write",
+    [BENCH_OP_LIST] = "list",
+    [BENCH_OP_CREATE] = "create",
+};
+
+typedef struct BenchOptions
+{
+    const char *host;
+    const char *port;
+    uint32_t connections;
+    uint32_t duration_s;
+    uint32_t weights[BENCH_OPS_COUNT];
+    // tree shape: every directory down to depth has fanout subdirectories and files_count files
+    uint32_t depth;
+    uint32_t fanout;
+    uint32_t files_count;
+    uint32_t file_size;
+    uint32_t io_size;
+    uint32_t list_plus;
+} BenchOptions;
+
+// an object of the tree together with the entry that names it
+typedef struct BenchNode
+{
+    ObjectInfo info;
+    __u64 parent_inode_n;
+    Handle parent_handle;
+    char name[BENCH_NAME_SIZE];
+} BenchNode;
+
+typedef struct BenchTree
+{
+    BenchNode *dirs;
+    uint32_t dirs_count;
+    BenchNode *files;
+    uint32_t files_count;
+} BenchTree;
+
+
+typedef struct OpResults
+{
+    uint64_t count;
+    uint64_t errors;
+    uint64_t bytes;
+    Histogram latency;
+} OpResults;
+
+
+typedef struct Worker
+{
+    uint32_t worker_n;
+    pthread_t thread;
+    Connection conn;
+    uint64_t random;
+    uint64_t created;
+    int failed;
+    OpResults results[BENCH_OPS_COUNT];
+} Worker;
+
+static BenchOptions opts;
+static BenchTree tree;
+static uint64_t deadline_ns;
+
+
+// xorshift64*, every worker has its own state
+static uint64_t bench_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+
+static int bench_create(Connection *conn, BenchNode *parent, const char *name, uint32_t type, BenchNode *node)
+{
+    MethodRequest req = { .type = METHOD_TYPE_CREATE };
+    MethodResponse resp;
+    req.create.type = type;
+    req.create.parent_inode_n = parent->info.inode_n;
+    req.create.parent_handle = parent->info.handle;
+    strcpy(req.create.name, name);
+    int res = bench_call(conn, &req, &resp);
+    if (res != 0)
+        return res;
+
+    node->info.type = type;
+    node->info.inode_n = resp.create.inode_n;
+    node->info.handle = resp.create.handle;
+    node->parent_inode_n = parent->info.inode_n;
+    node->parent_handle = parent->info.handle;
+    strcpy(node->name, name);
+    return 0;
+}
+
+static int bench_fill(Connection *conn, BenchNode *file)
+{
+    for (uint32_t offset = 0; offset < opts.file_size; offset += opts.io_size)
+    {
+        MethodRequest req = { .type = METHOD_TYPE_WRITE };
+        MethodResponse resp;
+        req.write.inode_n = file->info.inode_n;
+        req.write.handle = file->info.handle;
+        req.write.offset = offset;
+        req.write.length = opts.file_size - offset < opts.io_size ? opts.file_size - offset : opts.io_size;
+        if (bench_call(conn, &req, &resp) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int bench_build_dir(Connection *conn, uint32_t dir_n, uint32_t depth)
+{
+    char name[BENCH_NAME_SIZE];
+    for (uint32_t i = 0; i < opts.files_count; i++)
+    {
+        BenchNode *file = &tree.files[tree.files_count];
+        snprintf(name, sizeof(name), "f%u", i);
+        if ((bench_create(conn, &tree.dirs[dir_n], name, OBJECT_TYPE_FILE, file) != 0) || (bench_fill(conn, file) < 0))
+            return -1;
+        tree.files_count++;
+    }
+
+    if (depth == opts.depth)
+        return 0;
+    for (uint32_t i = 0; i < opts.fanout; i++)
+    {
+        uint32_t child_n = tree.dirs_count;
+        snprintf(name, sizeof(name), "d%u", i);
+        if (bench_create(conn, &tree.dirs[dir_n], name, OBJECT_TYPE_DIR, &tree.dirs[child_n]) != 0)
+            return -1;
+        tree.dirs_count++;
+        if (bench_build_dir(conn, child_n, depth + 1) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// builds a fresh tree in a directory named after the pid so runs don't collide
+static int bench_build_tree(Connection *conn)
+{
+    uint64_t dirs_count = 1;
+    uint64_t level = 1;
+    for (uint32_t i = 0; i < opts.depth; i++)
+    {
+        level *= opts.fanout;
+        dirs_count += level;
+    }
+    if (dirs_count * (opts.files_count + 1) > 10000000)
+    {
+        printf("tree is too large: %llu directories\n", (unsigned long long) dirs_count);
+        return -1;
+    }
+    tree.dirs = calloc(dirs_count, sizeof(BenchNode));
+    tree.files = calloc(dirs_count * opts.files_count + 1, sizeof(BenchNode));
+    if (!tree.dirs | !tree.files)
+        return -1;
+
+    MethodRequest req = { .type = METHOD_TYPE_MOUNT };
+    MethodResponse resp;
+    if (bench_call(conn, &req, &resp) != 0)
+        return -1;
+    if (opts.io_size > resp.mount.wsize)
+        opts.io_size = resp.mount.wsize;
+    if (opts.io_size > resp.mount.rsize)
+        opts.io_size = resp.mount.rsize;
+
+    BenchNode root = { .info = { .type = OBJECT_TYPE_DIR, .inode_n = resp.mount.inode_n, .handle = resp.mount.handle } };
+    char name[BENCH_NAME_SIZE];
+    snprintf(name, sizeof(name), "bench-%d", getpid());
+    if (bench_create(conn, &root, name, OBJECT_TYPE_DIR, &tree.dirs[0]) != 0)
+        return -1;
+    tree.dirs_count = 1;
+
+    uint64_t start = bench_now();
+    if (bench_build_dir(conn, 0, 0) < 0)
+        return -1;
+    printf("tree %s: %u dirs, %u files of %u bytes in %.2f s\n", name, tree.dirs_count, tree.files_count,
+           opts.file_size, (bench_now() - start) / 1e9);
+    return 0;
+}
+
+static BenchNode * bench_pick(Worker *worker, BenchNode *nodes, uint32_t count)
+{
+    return &nodes[bench_random(&worker->random) % count];
+}
+
+// runs one operation of the mix and returns the payload bytes it moved or -1 on error
+static int64_t bench_op(Worker *worker, BenchOp op)
+{
+    Connection *conn = &worker->conn;
+    MethodRequest req = { 0 };
+    MethodResponse resp;
+    int res;
+    switch (op)
+    {
+        case BENCH_OP_LOOKUP:
+        {
+            BenchNode *node = bench_pick(worker, tree.files, tree.files_count);
+            req.type = METHOD_TYPE_LOOKUP;
+            req.lookup.parent_inode_n = node->parent_inode_n;
+            req.lookup.parent_handle = node->parent_handle;
+            strcpy(req.lookup.name, node->name);
+            res = bench_call(conn, &req, &resp);
+            break;
+        }
+        case BENCH_OP_READ:
+        case BENCH_OP_WRITE:
+        {
+            BenchNode *file = bench_pick(worker, tree.files, tree.files_count);
+            uint32_t blocks = opts.file_size / opts.io_size;
+            uint64_t offset = blocks > 0 ? (bench_random(&worker->random) % blocks) * opts.io_size : 0;
+            if (op == BENCH_OP_READ)
+            {
+                req.type = METHOD_TYPE_READ;
+                req.read.inode_n = file->info.inode_n;
+                req.read.handle = file->info.handle;
+                req.read.offset = offset;
+                req.read.length = opts.io_size;
+                res = bench_call(conn, &req, &resp);
+                return res == 0 ? (int64_t) resp.read.length : (res < 0 ? -2 : -1);
+            }
+            req.type = METHOD_TYPE_WRITE;
+            req.write.inode_n = file->info.inode_n;
+            req.write.handle = file->info.handle;
+            req.write.offset = offset;
+            req.write.length = opts.io_size;
+            res = bench_call(conn, &req, &resp);
+            return res == 0 ? (int64_t) resp.write.length : (res < 0 ? -2 : -1);
+        }
+        case BENCH_OP_LIST:
+        {
+            // one page of a directory, like a getdents call
+            BenchNode *dir = bench_pick(worker, tree.dirs, tree.dirs_count);
+            req.type = METHOD_TYPE_LIST;
+            req.list.inode_n = dir->info.inode_n;
+            req.list.handle = dir->info.handle;
+            req.list.plus = opts.list_plus;
+            res = bench_call(conn, &req, &resp);
+            break;
+        }
+        case BENCH_OP_CREATE:
+        {
+            BenchNode *dir = bench_pick(worker, tree.dirs, tree.dirs_count);
+            BenchNode node;
+            char name[BENCH_NAME_SIZE];
+            snprintf(name, sizeof(name), "c%u-%llu", worker->worker_n, (unsigned long long) worker->created++);
+            res = bench_create(conn, dir, name, OBJECT_TYPE_FILE, &node);
+            break;
+        }
+        default:
+            return -1;
+    }
+    return res == 0 ? 0 : (res < 0 ? -2 : -1);
+}
+
+static BenchOp bench_pick_op(Worker *worker, uint32_t weights_total)
+{
+    uint32_t ticket = bench_random(&worker->random) % weights_total;
+    for (uint32_t op = 0; op < BENCH_OPS_COUNT; op++)
+    {
+        if (ticket < opts.weights[op])
+            return op;
+        ticket -= opts.weights[op];
+    }
+    return BENCH_OP_LOOKUP;
+}
+
+static void * bench_worker(void *arg)
+{
+    Worker *worker = arg;
+    uint32_t weights_total = 0;
+    for (uint32_t op = 0; op < BENCH_OPS_COUNT; op++)
+        weights_total += opts.weights[op];
+
+    while (bench_now() < deadline_ns)
+    {
+        BenchOp op = bench_pick_op(worker, weights_total);
+        uint64_t start = bench_now();
+        int64_t res = bench_op(worker, op);
+        uint64_t elapsed = bench_now() - start;
+        if (res == -2)
+        {
+            worker->failed = 1;
+            break;
+        }
+
+        OpResults *results = &worker->results[op];
+        results->count++;
+        if (res < 0)
+            results->errors++;
+        else
+            results->bytes += res;
+        histogram_add(&results->latency, elapsed);
+    }
+    return 0;
+}
+
+static void bench_report_line(const char *name, OpResults *results, double seconds)
+{
+    printf("%-8s %10llu %10llu %12.1f %10.2f %10.1f %10.1f %10.1f %10.1f\n", name,
+           (unsigned long long) results->count, (unsigned long long) results->errors,
+           results->count / seconds, results->bytes / seconds / (1024 * 1024),
+           histogram_percentile(&results->latency, results->count, 500) / 1e3,
+           histogram_percentile(&results->latency, results->count, 990) / 1e3,
+           histogram_percentile(&results->latency, results->count, 999) / 1e3,
+           results->latency.max / 1e3);
+}
+
+static void bench_report(Worker *workers, double seconds)
+{
+    static OpResults totals[BENCH_OPS_COUNT];
+    static OpResults all;
+    for (uint32_t i = 0; i < opts.connections; i++)
+    {
+        for (uint32_t op = 0; op < BENCH_OPS_COUNT; op++)
+        {
+            OpResults *results = &workers[i].results[op];
+            totals[op].count += results->count;
+            totals[op].errors += results->errors;
+            totals[op].bytes += results->bytes;
+            histogram_merge(&totals[op].latency, &results->latency);
+        }
+    }
+
+    printf("%-8s %10s %10s %12s %10s %10s %10s %10s %10s\n", "op", "count", "errors", "ops/s", "MiB/s", "p50 us", "p99 us", "p999 us", "max us");
+    for (uint32_t op = 0; op < BENCH_OPS_COUNT; op++)
+    {
+        if (totals[op].count == 0)
+            continue;
+        bench_report_line(op_names[op], &totals[op], seconds);
+        all.count += totals[op].count;
+        all.errors += totals[op].errors;
+        all.bytes += totals[op].bytes;
+        histogram_merge(&all.latency, &totals[op].latency);
+    }
+    bench_report_line("total", &all, seconds);
+}
+
+// "read=70,write=30" sets the weights of the named operations, the others get 0
+static int bench_parse_mix(const char *mix)
+{
+    char *copy = strdup(mix);
+    if (!copy)
+        return -1;
+    memset(opts.weights, 0, sizeof(opts.weights));
+
+    int res = 0;
+    char *rest = copy;
+    char *item;
+    while ((item = strsep(&rest, ",")) && (res == 0))
+    {
+        char *value = strchr(item, '=');
+        res = -1;
+        if (!value)
+            break;
+        *value++ = 0;
+        for (uint32_t op = 0; op < BENCH_OPS_COUNT; op++)
+        {
+            if (!strcmp(item, op_names[op]))
+            {
+                opts.weights[op] = atoi(value);
+                res = 0;
+            }
+        }
+    }
+    free(copy);
+
+    uint32_t weights_total = 0;
+    for (uint32_t op = 0; op < BENCH_OPS_COUNT; op++)
+        weights_total += opts.weights[op];
+    return (res == 0) & (weights_total > 0) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    opts = (BenchOptions) {
+        .connections = 8,
+        .duration_s = 10,
+        .weights = { [BENCH_OP_LOOKUP] = 40, [BENCH_OP_READ] = 30, [BENCH_OP_WRITE] = 10, [BENCH_OP_LIST] = 10, [BENCH_OP_CREATE] = 10 },
+        .depth = 2,
+        .fanout = 4,
+        .files_count = 16,
+        .file_size = 64 * 1024,
+        .io_size = 4096,
+        .list_plus = 1,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:m:D:F:n:s:b:P")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                opts.connections = atoi(optarg);
+                break;
+            case 'd':
+                opts.duration_s = atoi(optarg);
+                break;
+            case 'm':
+                if (bench_parse_mix(optarg) < 0)
+                    goto usage;
+                break;
+            case 'D':
+                opts.depth = atoi(optarg);
+                break;
+            case 'F':
+                opts.fanout = atoi(optarg);
+                break;
+            case 'n':
+                opts.files_count = atoi(optarg);
+                break;
+            case 's':
+                opts.file_size = atoi(optarg);
+                break;
+            case 'b':
+                opts.io_size = atoi(optarg);
+                break;
+            case 'P':
+                opts.list_plus = 0;
+                break;
+            default:
+                goto usage;
+        }
+    }
+
+    if ((argc - optind != 2) | (opts.connections == 0) | (opts.connections > BENCH_MAX_CONNECTIONS)
+        | (opts.io_size == 0) | (opts.io_size > MAX_DATA_LENGTH) | (opts.files_count == 0))
+    {
+        usage:
+        printf("usage: bench [-c connections] [-d seconds] [-m mix] [-D depth] [-F fanout] [-n files] [-s file-size] [-b io-size] [-P] {host} {port}\n");
+        printf("  -c  concurrent connections, one thread each (default: 8)\n");
+        printf("  -d  duration of the measured run in seconds (default: 10)\n");
+        printf("  -m  weights of the operations (default: lookup=40,read=30,write=10,list=10,create=10)\n");
+        printf("  -D  depth of the directory tree (default: 2)\n");
+        printf("  -F  subdirectories per directory (default: 4)\n");
+        printf("  -n  files per directory (default: 16)\n");
+        printf("  -s  size of every file in bytes (default: 65536)\n");
+        printf("  -b  size of every read and write (default: 4096, capped by the mount rsize/wsize)\n");
+        printf("  -P  list without attributes instead of READDIRPLUS\n");
+        return -1;
+    }
+    opts.host = argv[optind];
+    opts.port = argv[optind + 1];
+
+    Connection setup;
+    if (connection_open(&setup, opts.host, opts.port) < 0)
+    {
+        printf("can't connect to %s:%s\n", opts.host, opts.port);
+        return -1;
+    }
+    memset(setup.data, 'a', MAX_DATA_LENGTH);
+    if (bench_build_tree(&setup) < 0)
+    {
+        printf("can't build the tree\n");
+        return -1;
+    }
+    connection_close(&setup);
+
+    Worker *workers = calloc(opts.connections, sizeof(Worker));
+    if (!workers)
+        return -1;
+    for (uint32_t i = 0; i < opts.connections; i++)
+    {
+        workers[i].worker_n = i;
+        workers[i].random = 0x9E3779B97F4A7C15ULL * (i + 1) ^ bench_now();
+        if (connection_open(&workers[i].conn, opts.host, opts.port) < 0)
+        {
+            printf("can't open connection %u\n", i);
+            return -1;
+        }
+        memset(workers[i].conn.data, 'b', MAX_DATA_LENGTH);
+    }
+
+    uint64_t start = bench_now();
+    deadline_ns = start + (uint64_t) opts.duration_s * 1000000000ULL;
+    for (uint32_t i = 0; i < opts.connections; i++)
+    {
+        if (pthread_create(&workers[i].thread, 0, bench_worker, &workers[i]) != 0)
+        {
+            printf("can't start worker %u\n", i);
+            return -1;
+        }
+    }
+
+    int failed = 0;
+    for (uint32_t i = 0; i < opts.connections; i++)
+    {
+        pthread_join(workers[i].thread, 0);
+        connection_close(&workers[i].conn);
+        failed |= workers[i].failed;
+    }
+    double seconds = (bench_now() - start) / 1e9;
+
+    printf("%u connections, %.2f s\n", opts.connections, seconds);
+    bench_report(workers, seconds);
+    if (failed)
+        printf("some connections broke, their results are partial\n");
+    return failed ? -1 : 0;
+}
\ No newline at end of file
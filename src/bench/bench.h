@@ -0,0 +1,190 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include "../shared/wire.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// shared by bench and replay
+
+// same log-linear buckets as the server statistics
+#define BENCH_SUB_BITS 3
+#define BENCH_MAX_EXPONENT 40
+#define BENCH_BUCKETS_COUNT (((BENCH_MAX_EXPONENT - BENCH_SUB_BITS) + 2) << BENCH_SUB_BITS)
+
+typedef struct Histogram
+{
+    uint64_t buckets[BENCH_BUCKETS_COUNT];
+    uint64_t max;
+} Histogram;
+
+typedef struct Connection
+{
+    int fd;
+    __u32 xid;
+    __u8 *buf;
+    char *data;
+} Connection;
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint32_t histogram_bucket(uint64_t value)
+{
+    if (value < (1 << BENCH_SUB_BITS))
+        return value;
+    uint32_t exponent = 63 - __builtin_clzll(value);
+    if (exponent > BENCH_MAX_EXPONENT)
+        return BENCH_BUCKETS_COUNT - 1;
+    uint32_t sub = (value >> (exponent - BENCH_SUB_BITS)) & ((1 << BENCH_SUB_BITS) - 1);
+    return ((exponent - BENCH_SUB_BITS + 1) << BENCH_SUB_BITS) + sub;
+}
+
+static inline uint64_t histogram_bucket_limit(uint32_t bucket)
+{
+    if (bucket < (1 << BENCH_SUB_BITS))
+        return bucket;
+    uint32_t exponent = (bucket >> BENCH_SUB_BITS) + BENCH_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1 << BENCH_SUB_BITS) - 1);
+    uint32_t shift = exponent - BENCH_SUB_BITS;
+    return (((1ULL << BENCH_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+static inline void histogram_add(Histogram *histogram, uint64_t value)
+{
+    histogram->buckets[histogram_bucket(value)]++;
+    if (value > histogram->max)
+        histogram->max = value;
+}
+
+static inline void histogram_merge(Histogram *to, Histogram *from)
+{
+    for (uint32_t i = 0; i < BENCH_BUCKETS_COUNT; i++)
+        to->buckets[i] += from->buckets[i];
+    if (from->max > to->max)
+        to->max = from->max;
+}
+
+// permille is 500 for the median, upper bound of the bucket capped by the max
+static inline uint64_t histogram_percentile(Histogram *histogram, uint64_t total, uint32_t permille)
+{
+    uint64_t rank = (total * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BENCH_BUCKETS_COUNT; i++)
+    {
+        seen += histogram->buckets[i];
+        if ((seen >= rank) & (seen > 0))
+        {
+            uint64_t limit = histogram_bucket_limit(i);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static inline int read_full(int fd, void *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = read(fd, (char *) buf + done, len - done);
+        if ((n < 0) && (errno == EINTR))
+            continue;
+        if (n <= 0)
+            return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static inline int write_full(int fd, const void *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = write(fd, (const char *) buf + done, len - done);
+        if ((n < 0) && (errno == EINTR))
+            continue;
+        if (n <= 0)
+            return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static inline int connection_open(Connection *conn, const char *host, const char *port)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *addrs;
+    if (getaddrinfo(host, port, &hints, &addrs) != 0)
+        return -1;
+
+    conn->fd = -1;
+    for (struct addrinfo *addr = addrs; addr && (conn->fd < 0); addr = addr->ai_next)
+    {
+        conn->fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if ((conn->fd >= 0) && (connect(conn->fd, addr->ai_addr, addr->ai_addrlen) < 0))
+        {
+            close(conn->fd);
+            conn->fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+    if (conn->fd < 0)
+        return -1;
+
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    conn->xid = 0;
+    conn->buf = malloc(WIRE_MAX_BODY_SIZE);
+    conn->data = malloc(MAX_DATA_LENGTH);
+    if (!conn->buf | !conn->data)
+        return -1;
+    return 0;
+}
+
+static inline void connection_close(Connection *conn)
+{
+    close(conn->fd);
+    free(conn->buf);
+    free(conn->data);
+}
+
+// returns 0 on success, 1 when the server failed the request and -1 when the connection broke.
+// WRITE data is taken from conn->data, READ data lands there
+static inline int bench_call(Connection *conn, MethodRequest *req, MethodResponse *resp)
+{
+    req->xid = ++conn->xid;
+    int size = wire_encode_request(req, conn->buf, WIRE_MAX_BODY_SIZE);
+    if ((size < 0) || (write_full(conn->fd, conn->buf, size) < 0))
+        return -1;
+    uint32_t data_length = method_request_data_length(req);
+    if ((data_length > 0) && (write_full(conn->fd, conn->data, data_length) < 0))
+        return -1;
+
+    WireHeader hdr;
+    if ((read_full(conn->fd, conn->buf, WIRE_HEADER_SIZE) < 0) || (wire_get_header(conn->buf, &hdr) < 0))
+        return -1;
+    if ((hdr.data_length > MAX_DATA_LENGTH) || (read_full(conn->fd, conn->buf, hdr.body_length) < 0))
+        return -1;
+    if ((wire_decode_response(&hdr, conn->buf, resp) < 0) || (resp->xid != req->xid))
+        return -1;
+    if ((hdr.data_length > 0) && (read_full(conn->fd, conn->data, hdr.data_length) < 0))
+        return -1;
+    return resp->status == METHOD_STATUS_OK ? 0 : 1;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,675 @@
+#include "bench.h"
+#include "../shared/trace.h"
+
+#include <stdio.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define REPLAY_MAX_LANES 1024
+#define REPLAY_DEFAULT_LANES 64
+#define REPLAY_MAX_METHODS 16
+#define REPLAY_INODE_MAP_INITIAL_BUCKETS 1024
+
+static const char *method_names[REPLAY_MAX_METHODS] = {
+    [METHOD_TYPE_CREATE] = "create",
+    [METHOD_TYPE_LINK] = "link",
+    [METHOD_TYPE_UNLINK] = "unlink",
+    [METHOD_TYPE_READ] = "read",
+    [METHOD_TYPE_WRITE] = "write",
+    [METHOD_TYPE_LIST] = "list",
+    [METHOD_TYPE_RMDIR] = "rmdir",
+    [METHOD_TYPE_LOOKUP] = "lookup",
+    [METHOD_TYPE_MOUNT] = "mount",
+    [METHOD_TYPE_COMPOUND] = "compound",
+    [METHOD_TYPE_STATS] = "stats",
+    [METHOD_TYPE_GETATTR] = "getattr",
+};
+
+typedef struct ReplayEntry
+{
+    uint64_t time_ns;
+    uint64_t end_ns;
+    // where the entry starts in the trace file
+    uint32_t offset;
+    // position among all entries ordered by the time they finished
+    uint32_t end_rank;
+    // how many entries had finished when this one started, they have to finish first
+    uint32_t after;
+} ReplayEntry;
+
+typedef struct MethodResults
+{
+    uint64_t count;
+    uint64_t errors;
+    // status differs from the one in the trace
+    uint64_t mismatches;
+    Histogram traced;
+    Histogram replayed;
+} MethodResults;
+
+// the traced connections are folded onto lanes, one connection and thread each
+typedef struct Lane
+{
+    pthread_t thread;
+    Connection conn;
+    // indexes into entries in start order
+    uint32_t *order;
+    uint32_t entries_count;
+    int failed;
+    // requests sent later than the trace says they should have been
+    uint64_t late;
+    MethodResults results[REPLAY_MAX_METHODS];
+} Lane;
+
+typedef struct InodeMapEntry
+{
+    __u64 traced;
+    __u64 replayed;
+    struct InodeMapEntry *next;
+} InodeMapEntry;
+
+// inode numbers seen in the trace to the ones the replay target gave out for the same objects
+typedef struct InodeMap
+{
+    InodeMapEntry **buckets;
+    uint32_t buckets_count;
+    uint32_t count;
+    pthread_rwlock_t lock;
+} InodeMap;
+
+typedef struct ReplayOptions
+{
+    const char *host;
+    const char *port;
+    uint32_t lanes_count;
+    // 0 replays as fast as possible
+    double speed;
+} ReplayOptions;
+
+// a request waits until every request that finished before it started in the trace
+// has finished in the replay too, so dependencies between connections hold at any speed
+typedef struct Progress
+{
+    uint8_t *done;
+    // all entries with a lower end_rank are done
+    uint32_t finished;
+    pthread_mutex_t lock;
+    pthread_cond_t advanced;
+} Progress;
+
+static ReplayOptions opts;
+static uint8_t *trace_data;
+static size_t trace_size;
+static ReplayEntry *entries;
+static uint32_t entries_count;
+static Lane *lanes;
+static InodeMap inodes;
+static Progress progress;
+static uint64_t started_ns;
+
+static uint32_t inode_map_bucket(uint32_t buckets_count, __u64 inode_n)
+{
+    return (uint32_t) ((inode_n * 0x9E3779B97F4A7C15ULL) >> 17) & (buckets_count - 1);
+}
+
+static __u64 inode_map_get(__u64 traced)
+{
+    __u64 replayed = traced;
+    pthread_rwlock_rdlock(&inodes.lock);
+    InodeMapEntry *entry = inodes.buckets[inode_map_bucket(inodes.buckets_count, traced)];
+    while (entry && (entry->traced != traced))
+        entry = entry->next;
+    if (entry)
+        replayed = entry->replayed;
+    pthread_rwlock_unlock(&inodes.lock);
+    return replayed;
+}
+
+static void inode_map_grow_locked(void)
+{
+    uint32_t buckets_count = inodes.buckets_count * 2;
+    InodeMapEntry **buckets = calloc(buckets_count, sizeof(InodeMapEntry *));
+    if (!buckets)
+        return;
+    for (uint32_t i = 0; i < inodes.buckets_count; i++)
+    {
+        InodeMapEntry *entry = inodes.buckets[i];
+        while (entry)
+        {
+            InodeMapEntry *next = entry->next;
+            uint32_t bucket = inode_map_bucket(buckets_count, entry->traced);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(inodes.buckets);
+    inodes.buckets = buckets;
+    inodes.buckets_count = buckets_count;
+}
+
+static void inode_map_put(__u64 traced, __u64 replayed)
+{
+    pthread_rwlock_wrlock(&inodes.lock);
+    InodeMapEntry *entry = inodes.buckets[inode_map_bucket(inodes.buckets_count, traced)];
+    while (entry && (entry->traced != traced))
+        entry = entry->next;
+    if (!entry)
+    {
+        if (inodes.count >= inodes.buckets_count)
+            inode_map_grow_locked();
+        entry = malloc(sizeof(InodeMapEntry));
+        if (entry)
+        {
+            uint32_t bucket = inode_map_bucket(inodes.buckets_count, traced);
+            entry->traced = traced;
+            entry->next = inodes.buckets[bucket];
+            inodes.buckets[bucket] = entry;
+            inodes.count++;
+        }
+    }
+    if (entry)
+        entry->replayed = replayed;
+    pthread_rwlock_unlock(&inodes.lock);
+}
+
+// handles of the traced server mean nothing to the target, requests fall back to inode numbers
+static void replay_map_object(__u64 *inode_n, Handle *handle)
+{
+    if (compound_result_op(*inode_n) < 0)
+        *inode_n = inode_map_get(*inode_n);
+    handle->length = 0;
+}
+
+static void replay_map_op(__u32 type, void *op)
+{
+    switch (type)
+    {
+        case METHOD_TYPE_CREATE:
+        {
+            CreateRequest *req = op;
+            replay_map_object(&req->parent_inode_n, &req->parent_handle);
+            break;
+        }
+        case METHOD_TYPE_LINK:
+        {
+            LinkRequest *req = op;
+            replay_map_object(&req->source_inode_n, &req->source_handle);
+            replay_map_object(&req->parent_inode_n, &req->parent_handle);
+            break;
+        }
+        case METHOD_TYPE_UNLINK:
+        {
+            UnlinkRequest *req = op;
+            replay_map_object(&req->parent_inode_n, &req->parent_handle);
+            break;
+        }
+        case METHOD_TYPE_READ:
+        {
+            ReadRequest *req = op;
+            replay_map_object(&req->inode_n, &req->handle);
+            break;
+        }
+        case METHOD_TYPE_WRITE:
+        {
+            WriteRequest *req = op;
+            replay_map_object(&req->inode_n, &req->handle);
+            break;
+        }
+        case METHOD_TYPE_LIST:
+        {
+            ListRequest *req = op;
+            replay_map_object(&req->inode_n, &req->handle);
+            break;
+        }
+        case METHOD_TYPE_RMDIR:
+        {
+            RmdirRequest *req = op;
+            replay_map_object(&req->parent_inode_n, &req->parent_handle);
+            break;
+        }
+        case METHOD_TYPE_LOOKUP:
+        {
+            LookupRequest *req = op;
+            replay_map_object(&req->parent_inode_n, &req->parent_handle);
+            break;
+        }
+        case METHOD_TYPE_GETATTR:
+        {
+            GetattrRequest *req = op;
+            replay_map_object(&req->inode_n, &req->handle);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void replay_map_request(MethodRequest *req)
+{
+    if (req->type != METHOD_TYPE_COMPOUND)
+    {
+        replay_map_op(req->type, &req->create);
+        return;
+    }
+    for (uint32_t i = 0; i < req->compound.count; i++)
+        replay_map_op(req->compound.ops[i].type, &req->compound.ops[i].create);
+}
+
+// the same request named these objects in the trace and in the replay
+static void replay_map_result(__u32 type, const void *traced, const void *replayed)
+{
+    switch (type)
+    {
+        case METHOD_TYPE_CREATE:
+            inode_map_put(((const CreateResponse *) traced)->inode_n, ((const CreateResponse *) replayed)->inode_n);
+            break;
+        case METHOD_TYPE_LOOKUP:
+            inode_map_put(((const LookupResponse *) traced)->info.inode_n, ((const LookupResponse *) replayed)->info.inode_n);
+            break;
+        case METHOD_TYPE_MOUNT:
+            inode_map_put(((const MountResponse *) traced)->inode_n, ((const MountResponse *) replayed)->inode_n);
+            break;
+        case METHOD_TYPE_LIST:
+        {
+            // the target may list the directory in another order, entries are paired by name
+            const Objects *traced_objects = &((const ListResponse *) traced)->objects;
+            const Objects *replayed_objects = &((const ListResponse *) replayed)->objects;
+            for (uint32_t i = 0; i < traced_objects->count; i++)
+            {
+                for (uint32_t j = 0; j < replayed_objects->count; j++)
+                {
+                    if (!strcmp(traced_objects->objects[i].name, replayed_objects->objects[j].name))
+                    {
+                        inode_map_put(traced_objects->objects[i].info.inode_n, replayed_objects->objects[j].info.inode_n);
+                        break;
+                    }
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// response holds the traced reply as it was encoded, ops of a COMPOUND are paired by position
+static void replay_map_results(const uint8_t *response, uint32_t response_length, const MethodResponse *replayed)
+{
+    static __thread MethodResponse traced;
+    WireHeader hdr;
+    if ((response_length < WIRE_HEADER_SIZE) || (wire_get_header(response, &hdr) < 0)
+        || (WIRE_HEADER_SIZE + hdr.body_length > response_length)
+        || (wire_decode_response(&hdr, response + WIRE_HEADER_SIZE, &traced) < 0)
+        || (traced.type != replayed->type))
+        return;
+
+    if (traced.type != METHOD_TYPE_COMPOUND)
+    {
+        if ((traced.status == METHOD_STATUS_OK) & (replayed->status == METHOD_STATUS_OK))
+            replay_map_result(traced.type, &traced.create, &replayed->create);
+        return;
+    }
+    for (uint32_t i = 0; (i < traced.compound.count) & (i < replayed->compound.count); i++)
+    {
+        const CompoundOpResponse *traced_op = &traced.compound.ops[i];
+        const CompoundOpResponse *replayed_op = &replayed->compound.ops[i];
+        if ((traced_op->status == METHOD_STATUS_OK) & (replayed_op->status == METHOD_STATUS_OK) & (traced_op->type == replayed_op->type))
+            replay_map_result(traced_op->type, &traced_op->create, &replayed_op->create);
+    }
+}
+
+static void replay_sleep_until(uint64_t target_ns)
+{
+    uint64_t now = bench_now();
+    if (now >= target_ns)
+        return;
+    struct timespec ts = { .tv_sec = (target_ns - now) / 1000000000ULL, .tv_nsec = (target_ns - now) % 1000000000ULL };
+    nanosleep(&ts, 0);
+}
+
+static void progress_wait(uint32_t after)
+{
+    pthread_mutex_lock(&progress.lock);
+    while (progress.finished < after)
+        pthread_cond_wait(&progress.advanced, &progress.lock);
+    pthread_mutex_unlock(&progress.lock);
+}
+
+static void progress_done(ReplayEntry *entry)
+{
+    pthread_mutex_lock(&progress.lock);
+    progress.done[entry->end_rank] = 1;
+    uint32_t finished = progress.finished;
+    while ((progress.finished < entries_count) && progress.done[progress.finished])
+        progress.finished++;
+    if (progress.finished != finished)
+        pthread_cond_broadcast(&progress.advanced);
+    pthread_mutex_unlock(&progress.lock);
+}
+
+static void * replay_lane(void *arg)
+{
+    Lane *lane = arg;
+    MethodRequest req;
+    MethodResponse resp;
+    uint32_t i = 0;
+    for (; i < lane->entries_count; i++)
+    {
+        ReplayEntry *entry = &entries[lane->order[i]];
+        TraceRecord record;
+        WireHeader hdr;
+        const uint8_t *data = trace_data + entry->offset;
+        trace_get_record(data, &record);
+        wire_get_header(data + TRACE_RECORD_SIZE, &hdr);
+        if (wire_decode_request(&hdr, data + TRACE_RECORD_SIZE + WIRE_HEADER_SIZE, &req) < 0)
+        {
+            progress_done(entry);
+            continue;
+        }
+
+        if (opts.speed > 0)
+        {
+            uint64_t target = started_ns + (uint64_t) (entry->time_ns / opts.speed);
+            replay_sleep_until(target);
+            progress_wait(entry->after);
+            // a millisecond of slack before the request counts as late
+            if (bench_now() > target + 1000000)
+                lane->late++;
+        }
+        else
+            progress_wait(entry->after);
+        replay_map_request(&req);
+
+        uint64_t start = bench_now();
+        int res = bench_call(&lane->conn, &req, &resp);
+        uint64_t elapsed = bench_now() - start;
+        if (res < 0)
+        {
+            lane->failed = 1;
+            break;
+        }
+
+        if (record.response_length > 0)
+            replay_map_results(data + TRACE_RECORD_SIZE + WIRE_HEADER_SIZE + hdr.body_length, record.response_length, &resp);
+        progress_done(entry);
+
+        if (req.type >= REPLAY_MAX_METHODS)
+            continue;
+        MethodResults *results = &lane->results[req.type];
+        results->count++;
+        if (res > 0)
+            results->errors++;
+        if (resp.status != record.status)
+            results->mismatches++;
+        histogram_add(&results->traced, record.latency_ns);
+        histogram_add(&results->replayed, elapsed);
+    }
+
+    // a broken connection must not hold up the other lanes
+    for (; i < lane->entries_count; i++)
+        progress_done(&entries[lane->order[i]]);
+    return 0;
+}
+
+static int replay_add_entry(uint32_t *capacity, uint64_t time_ns, uint64_t end_ns, uint32_t offset)
+{
+    if (entries_count == *capacity)
+    {
+        uint32_t grown = *capacity ? *capacity * 2 : 1024;
+        ReplayEntry *grown_entries = realloc(entries, grown * sizeof(ReplayEntry));
+        if (!grown_entries)
+            return -1;
+        entries = grown_entries;
+        *capacity = grown;
+    }
+    entries[entries_count++] = (ReplayEntry) { .time_ns = time_ns, .end_ns = end_ns, .offset = offset };
+    return 0;
+}
+
+static int replay_compare_start(const void *a, const void *b)
+{
+    const ReplayEntry *x = &entries[*(const uint32_t *) a];
+    const ReplayEntry *y = &entries[*(const uint32_t *) b];
+    if (x->time_ns != y->time_ns)
+        return x->time_ns < y->time_ns ? -1 : 1;
+    return x->offset < y->offset ? -1 : (x->offset > y->offset);
+}
+
+static int replay_compare_end(const void *a, const void *b)
+{
+    const ReplayEntry *x = &entries[*(const uint32_t *) a];
+    const ReplayEntry *y = &entries[*(const uint32_t *) b];
+    if (x->end_ns != y->end_ns)
+        return x->end_ns < y->end_ns ? -1 : 1;
+    return x->offset < y->offset ? -1 : (x->offset > y->offset);
+}
+
+// ranks the entries by end time and spreads them over the lanes in start order
+static int replay_schedule(void)
+{
+    uint32_t *by_end = malloc(entries_count * sizeof(uint32_t) + 1);
+    uint32_t *by_start = malloc(entries_count * sizeof(uint32_t) + 1);
+    progress.done = calloc(entries_count + 1, 1);
+    if (!by_end | !by_start | !progress.done)
+        return -1;
+    for (uint32_t i = 0; i < entries_count; i++)
+    {
+        by_end[i] = i;
+        by_start[i] = i;
+    }
+    qsort(by_end, entries_count, sizeof(uint32_t), replay_compare_end);
+    qsort(by_start, entries_count, sizeof(uint32_t), replay_compare_start);
+
+    // both lists are sorted, so the entries finished before a start only grow
+    uint32_t finished = 0;
+    for (uint32_t i = 0; i < entries_count; i++)
+    {
+        entries[by_end[i]].end_rank = i;
+        ReplayEntry *entry = &entries[by_start[i]];
+        while ((finished < entries_count) && (entries[by_end[finished]].end_ns <= entry->time_ns))
+            finished++;
+        entry->after = finished;
+    }
+
+    for (uint32_t i = 0; i < entries_count; i++)
+    {
+        TraceRecord record;
+        trace_get_record(trace_data + entries[by_start[i]].offset, &record);
+        lanes[record.connection_n % opts.lanes_count].entries_count++;
+    }
+    for (uint32_t i = 0; i < opts.lanes_count; i++)
+    {
+        lanes[i].order = malloc(lanes[i].entries_count * sizeof(uint32_t) + 1);
+        if (!lanes[i].order)
+            return -1;
+        lanes[i].entries_count = 0;
+    }
+    for (uint32_t i = 0; i < entries_count; i++)
+    {
+        TraceRecord record;
+        trace_get_record(trace_data + entries[by_start[i]].offset, &record);
+        Lane *lane = &lanes[record.connection_n % opts.lanes_count];
+        lane->order[lane->entries_count++] = by_start[i];
+    }
+    free(by_end);
+    free(by_start);
+    return 0;
+}
+
+// returns the number of entries or -1 if the file isn't a trace
+static int64_t replay_load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return -1;
+    struct stat st;
+    if ((fstat(fileno(file), &st) < 0) | (st.st_size < TRACE_MAGIC_SIZE) | (st.st_size > UINT32_MAX))
+    {
+        fclose(file);
+        return -1;
+    }
+    trace_size = st.st_size;
+    trace_data = malloc(trace_size);
+    if (!trace_data || (fread(trace_data, 1, trace_size, file) != trace_size))
+    {
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    if (memcmp(trace_data, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0)
+        return -1;
+
+    // a trace cut off while the server was running may end in a partial entry
+    uint32_t capacity = 0;
+    uint64_t first_ns = UINT64_MAX;
+    size_t offset = TRACE_MAGIC_SIZE;
+    while (offset + TRACE_RECORD_SIZE + WIRE_HEADER_SIZE <= trace_size)
+    {
+        TraceRecord record;
+        WireHeader hdr;
+        trace_get_record(trace_data + offset, &record);
+        if (wire_get_header(trace_data + offset + TRACE_RECORD_SIZE, &hdr) < 0)
+            return -1;
+        size_t size = TRACE_RECORD_SIZE + WIRE_HEADER_SIZE + hdr.body_length + record.response_length;
+        if (offset + size > trace_size)
+            break;
+        if (replay_add_entry(&capacity, record.time_ns, record.time_ns + record.latency_ns, offset) < 0)
+            return -1;
+        if (record.time_ns < first_ns)
+            first_ns = record.time_ns;
+        offset += size;
+    }
+
+    // the replay starts with the first request, not with the traced server
+    for (uint32_t i = 0; i < entries_count; i++)
+    {
+        entries[i].time_ns -= first_ns;
+        entries[i].end_ns -= first_ns;
+    }
+    if (replay_schedule() < 0)
+        return -1;
+    return entries_count;
+}
+
+static void replay_report(double seconds, uint64_t count)
+{
+    static MethodResults totals[REPLAY_MAX_METHODS];
+    uint64_t late = 0;
+    for (uint32_t i = 0; i < opts.lanes_count; i++)
+    {
+        late += lanes[i].late;
+        for (uint32_t type = 0; type < REPLAY_MAX_METHODS; type++)
+        {
+            MethodResults *results = &lanes[i].results[type];
+            totals[type].count += results->count;
+            totals[type].errors += results->errors;
+            totals[type].mismatches += results->mismatches;
+            histogram_merge(&totals[type].traced, &results->traced);
+            histogram_merge(&totals[type].replayed, &results->replayed);
+        }
+    }
+
+    printf("%llu requests in %.2f s, %.1f req/s, %llu sent late\n", (unsigned long long) count, seconds, count / seconds, (unsigned long long) late);
+    printf("%-9s %10s %8s %8s %12s %12s %12s %12s\n", "method", "count", "errors", "differ",
+           "trace p50", "replay p50", "trace p99", "replay p99");
+    for (uint32_t type = 0; type < REPLAY_MAX_METHODS; type++)
+    {
+        MethodResults *results = &totals[type];
+        if (results->count == 0)
+            continue;
+        printf("%-9s %10llu %8llu %8llu %10.1fus %10.1fus %10.1fus %10.1fus\n",
+               method_names[type] ? method_names[type] : "unknown",
+               (unsigned long long) results->count, (unsigned long long) results->errors, (unsigned long long) results->mismatches,
+               histogram_percentile(&results->traced, results->count, 500) / 1e3,
+               histogram_percentile(&results->replayed, results->count, 500) / 1e3,
+               histogram_percentile(&results->traced, results->count, 990) / 1e3,
+               histogram_percentile(&results->replayed, results->count, 990) / 1e3);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    opts = (ReplayOptions) { .lanes_count = REPLAY_DEFAULT_LANES, .speed = 1 };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:x:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                opts.lanes_count = atoi(optarg);
+                break;
+            case 'x':
+                opts.speed = atof(optarg);
+                break;
+            default:
+                goto usage;
+        }
+    }
+
+    if ((argc - optind != 3) | (opts.lanes_count == 0) | (opts.lanes_count > REPLAY_MAX_LANES) | (opts.speed < 0))
+    {
+        usage:
+        printf("usage: replay [-c connections] [-x speed] {trace-file} {host} {port}\n");
+        printf("  -c  connections the traced ones are spread over (default: %d)\n", REPLAY_DEFAULT_LANES);
+        printf("  -x  speed relative to the trace, 2 is twice as fast, 0 as fast as possible (default: 1)\n");
+        return -1;
+    }
+    opts.host = argv[optind + 1];
+    opts.port = argv[optind + 2];
+
+    inodes.buckets_count = REPLAY_INODE_MAP_INITIAL_BUCKETS;
+    inodes.buckets = calloc(inodes.buckets_count, sizeof(InodeMapEntry *));
+    lanes = calloc(opts.lanes_count, sizeof(Lane));
+    if (!inodes.buckets | !lanes | (pthread_rwlock_init(&inodes.lock, 0) != 0))
+        return -1;
+    if ((pthread_mutex_init(&progress.lock, 0) != 0) | (pthread_cond_init(&progress.advanced, 0) != 0))
+        return -1;
+
+    int64_t count = replay_load(argv[optind]);
+    if (count < 0)
+    {
+        printf("can't load trace %s\n", argv[optind]);
+        return -1;
+    }
+    printf("trace %s: %lld requests\n", argv[optind], (long long) count);
+
+    for (uint32_t i = 0; i < opts.lanes_count; i++)
+    {
+        if (lanes[i].entries_count == 0)
+            continue;
+        if (connection_open(&lanes[i].conn, opts.host, opts.port) < 0)
+        {
+            printf("can't connect to %s:%s\n", opts.host, opts.port);
+            return -1;
+        }
+        memset(lanes[i].conn.data, 'r', MAX_DATA_LENGTH);
+    }
+
+    started_ns = bench_now();
+    for (uint32_t i = 0; i < opts.lanes_count; i++)
+    {
+        if ((lanes[i].entries_count > 0) && (pthread_create(&lanes[i].thread, 0, replay_lane, &lanes[i]) != 0))
+        {
+            printf("can't start lane %u\n", i);
+            return -1;
+        }
+    }
+
+    int failed = 0;
+    for (uint32_t i = 0; i < opts.lanes_count; i++)
+    {
+        if (lanes[i].entries_count == 0)
+            continue;
+        pthread_join(lanes[i].thread, 0);
+        connection_close(&lanes[i].conn);
+        failed |= lanes[i].failed;
+    }
+
+    replay_report((bench_now() - started_ns) / 1e9, count);
+    if (failed)
+        printf("some connections broke, the replay is partial\n");
+    return failed ? -1 : 0;
+}
\ No newline at end of file
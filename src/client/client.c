@@ -1,61 +1,422 @@
 #include "client.h"
 
-int call_method(ServerInfo *info, MethodRequest *req, MethodResponse *resp)
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/tcp.h>
+#include <net/tcp.h>
+
+int connection_pool_init(ConnectionPool *pool, uint32_t size)
+{
+    pool->connections = kcalloc(size, sizeof(Connection), GFP_KERNEL);
+    if (!pool->connections)
+        return -1;
+    pool->size = size;
+    atomic_set(&pool->next_xid, 0);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        Connection *conn = &pool->connections[i];
+        mutex_init(&conn->connect_lock);
+        mutex_init(&conn->send_lock);
+        spin_lock_init(&conn->lock);
+        INIT_LIST_HEAD(&conn->pending);
+    }
+    return 0;
+}
+
+struct socket * connect_to_server(ServerInfo *info)
 {
     struct socket *sock;
 
     if (sock_create_kern(&init_net, AF_INET, SOCK_STREAM, IPPROTO_TCP, &sock) < 0)
-        return -1;
-    
+        return 0;
+
     struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr = { .s_addr = in_aton(info->ip) }, .sin_port = htons(info->port) };
-    printk(KERN_INFO "addr: %s:%d", info->ip, info->port);
+    printk(KERN_INFO "connecting to %s:%d", info->ip, info->port);
 
     if (kernel_connect(sock, (struct sockaddr *) &addr, sizeof(struct sockaddr_in), 0) < 0)
     {
         printk(KERN_ERR "can't connect to server\n");
         sock_release(sock);
-        return -1;
+        return 0;
     }
+    // requests are small, don't let nagle hold them back
+    tcp_sock_set_nodelay(sock->sk);
+    return sock;
+}
 
-    struct msghdr hdr;
-    memset(&hdr, 0, sizeof(struct msghdr));
+// marks the connection dead and fails everything still waiting on it. Calls are completed
+// under the lock, so a caller that finds its call off the list knows it was answered
+void connection_fail(Connection *conn)
+{
+    spin_lock(&conn->lock);
+    conn->alive = false;
+    PendingCall *call, *tmp;
+    list_for_each_entry_safe(call, tmp, &conn->pending, list)
+    {
+        list_del_init(&call->list);
+        call->status = -1;
+        complete(&call->done);
+    }
+    conn->inflight = 0;
+    spin_unlock(&conn->lock);
 
-    struct kvec vec;
-    vec.iov_base = req;
-    vec.iov_len = sizeof(MethodRequest);
+    if (conn->sock)
+        kernel_sock_shutdown(conn->sock, SHUT_RDWR);
+}
 
-    if (kernel_sendmsg(sock, &hdr, &vec, 1, vec.iov_len) < 0)
+int recv_full(struct socket *sock, void *buf, size_t len)
+{
+    struct msghdr hdr;
+    struct kvec vec = { .iov_base = buf, .iov_len = len };
+    while (vec.iov_len > 0)
     {
-        printk(KERN_ERR "sendmsg error\n");
-        kernel_sock_shutdown(sock, SHUT_RDWR);
-        sock_release(sock);
-        return -1;
+        memset(&hdr, 0, sizeof(struct msghdr));
+        int recv = kernel_recvmsg(sock, &hdr, &vec, 1, vec.iov_len, 0);
+        if (recv <= 0)
+            return -1;
+        vec.iov_base += recv;
+        vec.iov_len -= recv;
     }
+    return 0;
+}
 
-    memset(resp, 0, sizeof(MethodResponse));
-    memset(&hdr, 0, sizeof(struct msghdr));
+// throws away data nobody waits for, using recv_buf as scratch space
+int recv_drain(Connection *conn, uint32_t len)
+{
+    while (len > 0)
+    {
+        uint32_t chunk = len > WIRE_MAX_BODY_SIZE ? WIRE_MAX_BODY_SIZE : len;
+        if (recv_full(conn->sock, conn->recv_buf, chunk) < 0)
+            return -1;
+        len -= chunk;
+    }
+    return 0;
+}
 
-    vec.iov_base = resp;
-    vec.iov_len = sizeof(MethodResponse);
+int connection_receiver(void *arg)
+{
+    Connection *conn = arg;
 
-    while (vec.iov_len > 0)
+    while (!kthread_should_stop())
     {
-        int recv = kernel_recvmsg(sock, &hdr, &vec, 1, vec.iov_len, 0);
-        if (recv == 0)
+        WireHeader header;
+        if (recv_full(conn->sock, conn->recv_header, WIRE_HEADER_SIZE) < 0)
             break;
-        if (recv < 0)
+        if (wire_get_header(conn->recv_header, &header) < 0)
         {
-            printk(KERN_ERR "recvmsg err\n");
-            kernel_sock_shutdown(sock, SHUT_RDWR);
-            sock_release(sock);
-            return -1;
+            printk(KERN_ERR "malformed response header\n");
+            break;
         }
-        vec.iov_base += recv;
-        vec.iov_len -= recv;
+        if (recv_full(conn->sock, conn->recv_buf, header.body_length) < 0)
+            break;
+
+        PendingCall *call = 0, *it;
+        spin_lock(&conn->lock);
+        list_for_each_entry(it, &conn->pending, list)
+        {
+            if (it->xid == header.xid)
+            {
+                call = it;
+                list_del_init(&call->list);
+                conn->inflight--;
+                break;
+            }
+        }
+        spin_unlock(&conn->lock);
+
+        // the caller may have been killed and given up on it
+        if (!call)
+        {
+            printk(KERN_INFO "response for unknown xid %u\n", header.xid);
+            if (recv_drain(conn, header.data_length) < 0)
+                break;
+            continue;
+        }
+
+        // the body is decoded before draining an oversized payload reuses recv_buf
+        call->status = 0;
+        call->received = WIRE_HEADER_SIZE + header.body_length + header.data_length;
+        if (wire_decode_response(&header, conn->recv_buf, call->resp) < 0)
+        {
+            printk(KERN_ERR "malformed response for xid %u\n", header.xid);
+            call->status = -1;
+        }
+        if (header.data_length > call->resp_data_size)
+        {
+            printk(KERN_ERR "response data is too long: %u\n", header.data_length);
+            call->status = -1;
+            if (recv_drain(conn, header.data_length) < 0)
+            {
+                complete(&call->done);
+                break;
+            }
+        }
+        else if (recv_full(conn->sock, call->resp_data, header.data_length) < 0)
+        {
+            call->status = -1;
+            complete(&call->done);
+            break;
+        }
+        complete(&call->done);
     }
 
-    kernel_sock_shutdown(sock, SHUT_RDWR);
-    sock_release(sock);
+    connection_fail(conn);
 
+    // the thread is reaped by connection_stop, wait for it there
+    set_current_state(TASK_INTERRUPTIBLE);
+    while (!kthread_should_stop())
+    {
+        schedule();
+        set_current_state(TASK_INTERRUPTIBLE);
+    }
+    __set_current_state(TASK_RUNNING);
     return 0;
-}
\ No newline at end of file
+}
+
+// caller holds connect_lock and send_lock
+void connection_stop(Connection *conn)
+{
+    if (!conn->sock)
+        return;
+    connection_fail(conn);
+    kthread_stop(conn->receiver);
+    sock_release(conn->sock);
+    kvfree(conn->recv_buf);
+    conn->sock = 0;
+    conn->receiver = 0;
+    conn->recv_buf = 0;
+}
+
+// (re)connects a dead connection, reused tells whether it was already up
+int connection_ensure(ServerInfo *info, Connection *conn, bool *reused)
+{
+    int res = 0;
+    mutex_lock(&conn->connect_lock);
+    *reused = READ_ONCE(conn->alive);
+    if (*reused)
+        goto out;
+
+    mutex_lock(&conn->send_lock);
+    connection_stop(conn);
+
+    conn->recv_buf = kvmalloc(WIRE_MAX_BODY_SIZE, GFP_KERNEL);
+    conn->sock = connect_to_server(info);
+    if (!conn->recv_buf | !conn->sock)
+    {
+        if (conn->sock)
+            sock_release(conn->sock);
+        kvfree(conn->recv_buf);
+        conn->sock = 0;
+        conn->recv_buf = 0;
+        res = -1;
+        goto out_send;
+    }
+
+    conn->generation++;
+    conn->alive = true;
+    conn->receiver = kthread_run(connection_receiver, conn, "pseudonfs-recv");
+    if (IS_ERR(conn->receiver))
+    {
+        conn->alive = false;
+        sock_release(conn->sock);
+        kvfree(conn->recv_buf);
+        conn->sock = 0;
+        conn->recv_buf = 0;
+        conn->receiver = 0;
+        res = -1;
+    }
+
+    out_send:
+    mutex_unlock(&conn->send_lock);
+    out:
+    mutex_unlock(&conn->connect_lock);
+    return res;
+}
+
+void connection_pool_clean(ConnectionPool *pool)
+{
+    for (uint32_t i = 0; i < pool->size; i++)
+    {
+        Connection *conn = &pool->connections[i];
+        mutex_lock(&conn->connect_lock);
+        mutex_lock(&conn->send_lock);
+        connection_stop(conn);
+        mutex_unlock(&conn->send_lock);
+        mutex_unlock(&conn->connect_lock);
+    }
+    kfree(pool->connections);
+    pool->connections = 0;
+    pool->size = 0;
+}
+
+// least loaded live connection, a new one is opened only when all live ones are busy.
+// Each connection is served by one server worker at a time, so concurrent callers
+// spread over up to nconnect streams and server threads
+Connection * connection_pool_pick(ConnectionPool *pool)
+{
+    Connection *best = 0, *dead = 0;
+    for (uint32_t i = 0; i < pool->size; i++)
+    {
+        Connection *conn = &pool->connections[i];
+        if (!READ_ONCE(conn->alive))
+        {
+            if (!dead)
+                dead = conn;
+            continue;
+        }
+        if (!best || (READ_ONCE(conn->inflight) < READ_ONCE(best->inflight)))
+            best = conn;
+    }
+    if (!best || (dead && (READ_ONCE(best->inflight) > 0)))
+        return dead;
+    return best;
+}
+
+// buf holds the encoded header and body, req_data follows them on the wire
+int connection_send(Connection *conn, uint32_t generation, void *buf, uint32_t size, const void *req_data, uint32_t req_data_length)
+{
+    int res = -1;
+    mutex_lock(&conn->send_lock);
+    // the connection may have been restarted since the call was queued on it
+    if (conn->alive & (conn->generation == generation))
+    {
+        struct msghdr hdr;
+        memset(&hdr, 0, sizeof(struct msghdr));
+        struct kvec vec[2] = {
+            { .iov_base = buf, .iov_len = size },
+            { .iov_base = (void *) req_data, .iov_len = req_data_length },
+        };
+        size_t len = vec[0].iov_len + vec[1].iov_len;
+        if (kernel_sendmsg(conn->sock, &hdr, vec, vec[1].iov_len > 0 ? 2 : 1, len) == len)
+        {
+            res = 0;
+        }
+        else
+        {
+            printk(KERN_ERR "sendmsg error\n");
+            connection_fail(conn);
+        }
+    }
+    mutex_unlock(&conn->send_lock);
+    return res;
+}
+
+// running these twice leaves the same result as running them once
+bool method_idempotent(uint32_t type)
+{
+    switch (type)
+    {
+        case METHOD_TYPE_READ:
+        case METHOD_TYPE_WRITE:
+        case METHOD_TYPE_LIST:
+        case METHOD_TYPE_LOOKUP:
+        case METHOD_TYPE_MOUNT:
+        case METHOD_TYPE_STATS:
+        case METHOD_TYPE_GETATTR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+int call_method(ServerInfo *info, MethodRequest *req, MethodResponse *resp)
+{
+    return call_method_data(info, req, 0, resp, 0, 0);
+}
+
+// req_data carries method_request_data_length(req) bytes, resp_data receives up to resp_data_size bytes
+int call_method_data(ServerInfo *info, MethodRequest *req, const void *req_data, MethodResponse *resp, void *resp_data, uint32_t resp_data_size)
+{
+    ConnectionPool *pool = &info->pool;
+    PendingCall call = { .received = 0 };
+    bool retried = false;
+    int res = -1;
+    uint64_t start_ns = ktime_get_ns();
+    uint64_t sent_ns = 0;
+    uint64_t sent = 0;
+
+    int size = wire_encode_request(req, 0, 0);
+    if (size < 0)
+        return -1;
+    void *buf = kmalloc(size, GFP_KERNEL);
+    if (!buf)
+        return -1;
+
+    while (1)
+    {
+        Connection *conn = connection_pool_pick(pool);
+        bool reused;
+        if (connection_ensure(info, conn, &reused) < 0)
+            break;
+
+        req->xid = atomic_inc_return(&pool->next_xid);
+        wire_encode_request(req, buf, size);
+        call.xid = req->xid;
+        call.resp = resp;
+        call.resp_data = resp_data;
+        call.resp_data_size = resp_data_size;
+        call.status = -1;
+        init_completion(&call.done);
+
+        spin_lock(&conn->lock);
+        // a connection that died right after connecting uses up the one retry, so that a server
+        // accepting and closing straight away can't keep the caller reconnecting forever
+        if (!conn->alive)
+        {
+            spin_unlock(&conn->lock);
+            if (retried | fatal_signal_pending(current))
+                break;
+            retried = true;
+            continue;
+        }
+        uint32_t generation = conn->generation;
+        list_add_tail(&call.list, &conn->pending);
+        conn->inflight++;
+        spin_unlock(&conn->lock);
+
+        // on failure the call has already been completed with an error
+        bool unsent = connection_send(conn, generation, buf, size, req_data, method_request_data_length(req)) < 0;
+        sent_ns = ktime_get_ns();
+        sent += size + method_request_data_length(req);
+
+        // a killed caller takes its call back, unless the receiver is already filling it in
+        if (wait_for_completion_killable(&call.done) < 0)
+        {
+            spin_lock(&conn->lock);
+            bool pending = !list_empty(&call.list);
+            if (pending)
+            {
+                list_del(&call.list);
+                conn->inflight--;
+            }
+            spin_unlock(&conn->lock);
+            if (pending)
+                break;
+            wait_for_completion(&call.done);
+        }
+        if (call.status == 0)
+        {
+            res = 0;
+            break;
+        }
+
+        // the server may have closed a connection that was idle, the request is resent once on a fresh one.
+        // Once a reply arrived, or the server may already have run a request that isn't safe to repeat, it is not
+        if (!reused | retried | (call.received > 0) | (!unsent & !method_idempotent(req->type)) | fatal_signal_pending(current))
+            break;
+        printk(KERN_INFO "connection lost, reconnecting\n");
+        retried = true;
+    }
+
+    // queue wait covers connecting, the send lock and a lost first attempt, rtt the last one
+    uint64_t done_ns = ktime_get_ns();
+    if (sent_ns == 0)
+        sent_ns = done_ns;
+    metrics_record(&info->metrics, req->type, (res < 0) || (resp->status == METHOD_STATUS_ERR), retried,
+                   sent, call.received, sent_ns - start_ns, done_ns - sent_ns);
+    kfree(buf);
+    return res;
+}
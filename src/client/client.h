@@ -2,15 +2,83 @@
 #define _CLIENT_H
 
 #include <linux/inet.h>
+#include <linux/net.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/completion.h>
+#include <linux/sched.h>
 
-#include "../shared/protocol.h"
+#include "../shared/wire.h"
+#include "metrics.h"
+
+// connections per mount unless nconnect says otherwise
+#define CONNECTION_POOL_SIZE 4
+#define CONNECTION_POOL_MAX_SIZE 16
+
+typedef struct PendingCall
+{
+    struct list_head list;
+    unsigned int xid;
+    MethodResponse *resp;
+    void *resp_data;
+    uint32_t resp_data_size;
+    int status;
+    // bytes of the reply as they came off the wire
+    uint32_t received;
+    struct completion done;
+} PendingCall;
+
+// one multiplexed connection: callers send under send_lock, the receiver thread completes them by xid
+typedef struct Connection
+{
+    struct socket *sock;
+    struct task_struct *receiver;
+    __u8 recv_header[WIRE_HEADER_SIZE];
+    __u8 *recv_buf;
+    struct mutex connect_lock;
+    struct mutex send_lock;
+    spinlock_t lock;
+    struct list_head pending;
+    uint32_t inflight;
+    uint32_t generation;
+    bool alive;
+} Connection;
+
+typedef struct ConnectionPool
+{
+    Connection *connections;
+    uint32_t size;
+    atomic_t next_xid;
+} ConnectionPool;
 
 typedef struct ServerInfo
 {
     char *ip;
     uint16_t port;
+    uint32_t rsize;
+    uint32_t wsize;
+    bool rdirplus;
+    // attribute cache timeouts in seconds, dentries age with their directory
+    uint32_t acregmin;
+    uint32_t acregmax;
+    uint32_t acdirmin;
+    uint32_t acdirmax;
+    // open always revalidates attributes (close-to-open consistency)
+    bool cto;
+    // bytes dirty on the mount before writers flush their files themselves, 0 leaves it to the kernel's limits
+    uint64_t max_dirty;
+    // readahead window limit in bytes
+    uint32_t rasize;
+    // connections the pool may open to the server
+    uint32_t nconnect;
+    ConnectionPool pool;
+    Metrics metrics;
 } ServerInfo;
 
+int connection_pool_init(ConnectionPool *pool, uint32_t size);
+void connection_pool_clean(ConnectionPool *pool);
 int call_method(ServerInfo *info, MethodRequest *req, MethodResponse *resp);
+int call_method_data(ServerInfo *info, MethodRequest *req, const void *req_data, MethodResponse *resp, void *resp_data, uint32_t resp_data_size);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "metrics.h"
+
+#include <linux/fs.h>
+#include <linux/log2.h>
+#include <linux/string.h>
+
+const char *metrics_method_names[STATS_MAX_METHODS] = {
+    [METHOD_TYPE_CREATE] = "create",
+    [METHOD_TYPE_LINK] = "link",
+    [METHOD_TYPE_UNLINK] = "unlink",
+    [METHOD_TYPE_READ] = "read",
+    [METHOD_TYPE_WRITE] = "write",
+    [METHOD_TYPE_LIST] = "list",
+    [METHOD_TYPE_RMDIR] = "rmdir",
+    [METHOD_TYPE_LOOKUP] = "lookup",
+    [METHOD_TYPE_MOUNT] = "mount",
+    [METHOD_TYPE_COMPOUND] = "compound",
+    [METHOD_TYPE_STATS] = "stats",
+    [METHOD_TYPE_GETATTR] = "getattr",
+};
+
+const char *metrics_cache_names[METRICS_CACHES_COUNT] = {
+    [METRICS_CACHE_ATTRS] = "attrs",
+    [METRICS_CACHE_DENTRIES] = "dentries",
+};
+
+// /sys/kernel/debug/pseudonfs, one directory per mount below it
+struct dentry *metrics_root;
+
+void metrics_init(Metrics *metrics)
+{
+    memset(metrics, 0, sizeof(Metrics));
+}
+
+uint32_t metrics_bucket(uint64_t ns)
+{
+    uint64_t us = ns / NSEC_PER_USEC;
+    if (us == 0)
+        return 0;
+    uint32_t bucket = ilog2(us) + 1;
+    return bucket < METRICS_BUCKETS_COUNT ? bucket : METRICS_BUCKETS_COUNT - 1;
+}
+
+void metrics_record(Metrics *metrics, uint32_t type, bool failed, bool retransmitted, uint64_t sent, uint64_t received, uint64_t queue_ns, uint64_t rtt_ns)
+{
+    if (type >= STATS_MAX_METHODS)
+        return;
+    MethodMetrics *method = &metrics->methods[type];
+    atomic64_inc(&method->calls);
+    if (failed)
+        atomic64_inc(&method->errors);
+    if (retransmitted)
+        atomic64_inc(&method->retransmits);
+    atomic64_add(sent, &method->bytes_sent);
+    atomic64_add(received, &method->bytes_received);
+    atomic64_add(queue_ns, &method->queue_ns);
+    atomic64_add(rtt_ns, &method->rtt_ns);
+    atomic64_inc(&method->queue[metrics_bucket(queue_ns)]);
+    atomic64_inc(&method->rtt[metrics_bucket(rtt_ns)]);
+}
+
+void metrics_count_cache(Metrics *metrics, MetricsCache cache, bool hit)
+{
+    atomic64_inc(hit ? &metrics->hits[cache] : &metrics->misses[cache]);
+}
+
+void metrics_show_histogram(struct seq_file *m, const char *kind, const char *name, atomic64_t *buckets)
+{
+    seq_printf(m, "%s %s", kind, name);
+    for (uint32_t i = 0; i < METRICS_BUCKETS_COUNT - 1; i++)
+        seq_printf(m, " %llu:%lld", 1ULL << i, atomic64_read(&buckets[i]));
+    seq_printf(m, " inf:%lld\n", atomic64_read(&buckets[METRICS_BUCKETS_COUNT - 1]));
+}
+
+// one record per line, the first word names it and the rest are key value pairs, histograms
+// list <upper bound in us>:<count> pairs. Every method is listed even when it was never called
+int metrics_show(struct seq_file *m, void *v)
+{
+    Metrics *metrics = m->private;
+    seq_printf(m, "version %d\n", METRICS_FORMAT_VERSION);
+    for (uint32_t i = 0; i < STATS_MAX_METHODS; i++)
+    {
+        MethodMetrics *method = &metrics->methods[i];
+        if (!metrics_method_names[i])
+            continue;
+        seq_printf(m, "method %s calls %lld errors %lld retransmits %lld bytes_sent %lld bytes_received %lld queue_ns %lld rtt_ns %lld\n",
+                   metrics_method_names[i], atomic64_read(&method->calls), atomic64_read(&method->errors),
+                   atomic64_read(&method->retransmits), atomic64_read(&method->bytes_sent), atomic64_read(&method->bytes_received),
+                   atomic64_read(&method->queue_ns), atomic64_read(&method->rtt_ns));
+    }
+    for (uint32_t i = 0; i < STATS_MAX_METHODS; i++)
+    {
+        if (!metrics_method_names[i])
+            continue;
+        metrics_show_histogram(m, "queue", metrics_method_names[i], metrics->methods[i].queue);
+        metrics_show_histogram(m, "rtt", metrics_method_names[i], metrics->methods[i].rtt);
+    }
+    for (uint32_t i = 0; i < METRICS_CACHES_COUNT; i++)
+        seq_printf(m, "cache %s hits %lld misses %lld\n", metrics_cache_names[i],
+                   atomic64_read(&metrics->hits[i]), atomic64_read(&metrics->misses[i]));
+    return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(metrics);
+
+// debugfs failures are not fatal, the mount just goes without its stats file
+void metrics_register(Metrics *metrics, const char *name)
+{
+    metrics->dir = debugfs_create_dir(name, metrics_root);
+    debugfs_create_file("stats", 0444, metrics->dir, metrics, &metrics_fops);
+}
+
+void metrics_unregister(Metrics *metrics)
+{
+    debugfs_remove(metrics->dir);
+    metrics->dir = 0;
+}
+
+void metrics_module_init(void)
+{
+    metrics_root = debugfs_create_dir("pseudonfs", NULL);
+}
+
+void metrics_module_exit(void)
+{
+    debugfs_remove(metrics_root);
+    metrics_root = 0;
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/types.h>
+
+#include "../shared/protocol.h"
+
+// bumped whenever a line of the stats file changes its meaning
+#define METRICS_FORMAT_VERSION 1
+// bucket i counts times below 2^i us, the last one everything longer
+#define METRICS_BUCKETS_COUNT 24
+
+typedef enum MetricsCache
+{
+    METRICS_CACHE_ATTRS = 0,
+    METRICS_CACHE_DENTRIES,
+    METRICS_CACHES_COUNT,
+} MetricsCache;
+
+typedef struct MethodMetrics
+{
+    atomic64_t calls;
+    atomic64_t errors;
+    atomic64_t retransmits;
+    atomic64_t bytes_sent;
+    atomic64_t bytes_received;
+    // queue is the time until the request was on the wire, rtt from there to the reply
+    atomic64_t queue_ns;
+    atomic64_t rtt_ns;
+    atomic64_t queue[METRICS_BUCKETS_COUNT];
+    atomic64_t rtt[METRICS_BUCKETS_COUNT];
+} MethodMetrics;
+
+// per mount, updated by all callers without locks
+typedef struct Metrics
+{
+    MethodMetrics methods[STATS_MAX_METHODS];
+    atomic64_t hits[METRICS_CACHES_COUNT];
+    atomic64_t misses[METRICS_CACHES_COUNT];
+    struct dentry *dir;
+} Metrics;
+
+void metrics_init(Metrics *metrics);
+void metrics_record(Metrics *metrics, uint32_t type, bool failed, bool retransmitted, uint64_t sent, uint64_t received, uint64_t queue_ns, uint64_t rtt_ns);
+void metrics_count_cache(Metrics *metrics, MetricsCache cache, bool hit);
+int metrics_show(struct seq_file *m, void *v);
+void metrics_register(Metrics *metrics, const char *name);
+void metrics_unregister(Metrics *metrics);
+void metrics_module_init(void);
+void metrics_module_exit(void);
+
+#endif
\ No newline at end of file
@@ -3,19 +3,57 @@
 MODULE_LICENSE("GPL");
 
 int pseudonfs_iterate(struct file *f, struct dir_context *ctxt);
-ssize_t pseudonfs_read(struct file *f, char *buffer, size_t len, loff_t *off);
-ssize_t pseudonfs_write(struct file *f, const char *buffer, size_t len, loff_t *off);
-
+void pseudonfs_prime_dentry(struct dentry *parent, Object *obj);
+ssize_t pseudonfs_read_data(struct inode *inode, loff_t offset, char *data, size_t len);
+ssize_t pseudonfs_write_data(struct inode *inode, loff_t offset, const char *data, size_t len);
+int pseudonfs_refresh_attrs(struct inode *inode);
+int pseudonfs_revalidate_mapping(struct inode *inode);
+
+int pseudonfs_file_open(struct inode *inode, struct file *f);
+ssize_t pseudonfs_file_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t pseudonfs_file_write_iter(struct kiocb *iocb, struct iov_iter *from);
+ssize_t pseudonfs_direct_read(struct kiocb *iocb, struct iov_iter *to);
+ssize_t pseudonfs_direct_write(struct kiocb *iocb, struct iov_iter *from);
+int pseudonfs_file_flush(struct file *f, fl_owner_t id);
+int pseudonfs_file_fsync(struct file *f, loff_t start, loff_t end, int datasync);
+
+void pseudonfs_fill_folio(struct folio *folio, const char *buf, size_t length);
+int pseudonfs_read_folio_data(struct inode *inode, struct folio *folio);
+int pseudonfs_read_folio(struct file *f, struct folio *folio);
+void pseudonfs_readahead_work(struct work_struct *work);
+void pseudonfs_readahead(struct readahead_control *ractl);
+int pseudonfs_write_begin(struct file *f, struct address_space *mapping, loff_t pos, unsigned len, struct page **pagep, void **fsdata);
+int pseudonfs_write_end(struct file *f, struct address_space *mapping, loff_t pos, unsigned len, unsigned copied, struct page *page, void *fsdata);
+int pseudonfs_writepage(struct page *page, struct writeback_control *wbc);
+int pseudonfs_flush_batch(PseudonfsWriteBatch *batch);
+int pseudonfs_writepage_batch(struct page *page, struct writeback_control *wbc, void *data);
+int pseudonfs_writepages(struct address_space *mapping, struct writeback_control *wbc);
+
+int pseudonfs_lookup_call(struct inode *parent_inode, const struct qstr *name, LookupResponse *found);
 struct dentry * pseudonfs_lookup(struct inode *parent_inode, struct dentry *child_dentry, unsigned int flag);
 int pseudonfs_create(struct user_namespace *u_nmspc, struct inode *parent_inode, struct dentry *child_dentry, umode_t mode, bool b);
 int pseudonfs_mkdir(struct user_namespace *u_nmspc, struct inode *parent_inode, struct dentry *child_dentry, umode_t mode);
 int pseudonfs_rmdir(struct inode *parent_inode, struct dentry *child_dentry);
 int pseudonfs_link(struct dentry *old_dentry, struct inode *parent_inode, struct dentry *new_dentry);
 int pseudonfs_unlink(struct inode *parent_inode, struct dentry *child_dentry);
+int pseudonfs_getattr(struct user_namespace *u_nmspc, const struct path *path, struct kstat *stat, u32 request_mask, unsigned int flags);
+int pseudonfs_d_revalidate(struct dentry *dentry, unsigned int flags);
 
+struct inode * pseudonfs_alloc_inode(struct super_block *sb);
+void pseudonfs_free_inode(struct inode *inode);
+void pseudonfs_init_once(void *obj);
+void pseudonfs_evict_inode(struct inode *inode);
 void pseudonfs_kill_sb(struct super_block *sb);
-struct inode * pseudonfs_get_inode(struct super_block *sb, const struct inode *dir, umode_t mode, int i_ino);
+void pseudonfs_fill_handle(struct inode *inode, Handle *handle);
+void pseudonfs_set_attrs(struct inode *inode, ObjectAttrs *attrs);
+void pseudonfs_set_written_attrs(struct inode *inode, ObjectAttrs *attrs);
+bool pseudonfs_attrs_fresh(struct inode *inode);
+void pseudonfs_expire_attrs(struct inode *inode);
+int pseudonfs_inode_test(struct inode *inode, void *data);
+int pseudonfs_inode_set(struct inode *inode, void *data);
+struct inode * pseudonfs_get_inode(struct super_block *sb, const struct inode *dir, umode_t mode, unsigned long i_ino, Handle *handle);
 int pseudonfs_fill_super(struct super_block *sb, void *data, int silent);
+int pseudonfs_parse_options(ServerInfo *info, const char *data);
 struct dentry * pseudonfs_mount(struct file_system_type *type, int flags, const char *addr, void *data);
 
 int pseudonfs_init(void);
@@ -23,13 +61,41 @@ void pseudonfs_exit(void);
 
 struct file_system_type pseudonfs_fs_type = { .name = "pseudonfs", .mount = pseudonfs_mount, .kill_sb = pseudonfs_kill_sb };
 
+struct kmem_cache *pseudonfs_inode_cachep;
+struct workqueue_struct *pseudonfs_read_wq;
+
 struct file_operations pseudonfs_dir_ops = {
     .iterate = pseudonfs_iterate,
-    .read = pseudonfs_read,
-    .write = pseudonfs_write,
+    .read = generic_read_dir,
+};
+
+// regular files go through the page cache, see pseudonfs_aops
+struct file_operations pseudonfs_file_ops = {
+    .open = pseudonfs_file_open,
+    .llseek = generic_file_llseek,
+    .read_iter = pseudonfs_file_read_iter,
+    .write_iter = pseudonfs_file_write_iter,
+    .splice_read = generic_file_splice_read,
+    .splice_write = iter_file_splice_write,
+    .mmap = generic_file_mmap,
+    .flush = pseudonfs_file_flush,
+    .fsync = pseudonfs_file_fsync,
+};
+
+struct address_space_operations pseudonfs_aops = {
+    .read_folio = pseudonfs_read_folio,
+    .readahead = pseudonfs_readahead,
+    .writepage = pseudonfs_writepage,
+    .writepages = pseudonfs_writepages,
+    .write_begin = pseudonfs_write_begin,
+    .write_end = pseudonfs_write_end,
+    .dirty_folio = filemap_dirty_folio,
+    // O_DIRECT is handled in read_iter and write_iter, this only lets open accept it
+    .direct_IO = noop_direct_IO,
 };
 
 struct inode_operations pseudonfs_inode_ops = {
+    .getattr = pseudonfs_getattr,
     .lookup = pseudonfs_lookup,
     .create = pseudonfs_create,
     .mkdir = pseudonfs_mkdir,
@@ -38,140 +104,719 @@ struct inode_operations pseudonfs_inode_ops = {
     .unlink = pseudonfs_unlink,
 };
 
+struct dentry_operations pseudonfs_dentry_ops = {
+    .d_revalidate = pseudonfs_d_revalidate,
+};
+
+struct super_operations pseudonfs_super_ops = {
+    .alloc_inode = pseudonfs_alloc_inode,
+    .free_inode = pseudonfs_free_inode,
+    .evict_inode = pseudonfs_evict_inode,
+};
+
 
 int pseudonfs_iterate(struct file *f, struct dir_context *ctxt)
 {
     struct inode *inode = f->f_inode;
+    ServerInfo *info = inode->i_sb->s_fs_info;
     MethodRequest *req = kmalloc(sizeof(struct MethodRequest), GFP_KERNEL);
-    memset(req, 0, sizeof(MethodRequest));
-    req->type = METHOD_TYPE_LIST;
-    req->list = (ListRequest) { .inode_n = inode->i_ino };
     MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
-    if (call_method(inode->i_sb->s_fs_info, req, resp) < 0)
+    int res = 0;
+    if (!req | !resp)
     {
-        printk(KERN_ERR "iterate err\n");
-        return -1;
+        res = -ENOMEM;
+        goto out;
     }
-    if ((resp->status == METHOD_STATUS_ERR) | (resp->type != METHOD_TYPE_LIST))
+
+    // ctxt->pos is the server cookie of the last entry emitted, 0 is the beginning
+    bool eof = false;
+    while (!eof)
     {
-        printk(KERN_ERR "iterate call err\n");
-        return -1;
+        memset(req, 0, sizeof(MethodRequest));
+        req->type = METHOD_TYPE_LIST;
+        req->list = (ListRequest) { .inode_n = inode->i_ino, .cookie = ctxt->pos, .max_bytes = PSEUDONFS_READDIR_SIZE, .plus = info->rdirplus };
+        pseudonfs_fill_handle(inode, &req->list.handle);
+        if (call_method(info, req, resp) < 0)
+        {
+            printk(KERN_ERR "iterate err\n");
+            res = -EIO;
+            goto out;
+        }
+        if ((resp->status == METHOD_STATUS_ERR) | (resp->type != METHOD_TYPE_LIST))
+        {
+            printk(KERN_ERR "iterate call err\n");
+            res = -EIO;
+            goto out;
+        }
+
+        for (uint32_t i = 0; i < resp->list.objects.count; i++)
+        {
+            Object *obj = &resp->list.objects.objects[i];
+            if (resp->list.plus)
+                pseudonfs_prime_dentry(f->f_path.dentry, obj);
+            if (!dir_emit(ctxt, obj->name, strlen(obj->name), obj->info.inode_n, obj->info.type == OBJECT_TYPE_DIR ? DT_DIR : DT_REG))
+                goto out;
+            ctxt->pos = obj->cookie;
+        }
+        eof = resp->list.eof | (resp->list.objects.count == 0);
+    }
+
+    out:
+    kfree(req);
+    kfree(resp);
+    return res;
+}
+
+
+// READDIRPLUS entries are put into the dcache so that a following stat() needs no LOOKUP,
+// the caller holds the directory lock
+void pseudonfs_prime_dentry(struct dentry *parent, Object *obj)
+{
+    struct qstr name = QSTR_INIT(obj->name, strlen(obj->name));
+    struct dentry *dentry = d_hash_and_lookup(parent, &name);
+    if (IS_ERR(dentry))
+        return;
+
+    if (dentry && d_really_is_positive(dentry))
+    {
+        if (d_inode(dentry)->i_ino == obj->info.inode_n)
+        {
+            pseudonfs_set_attrs(d_inode(dentry), &obj->attrs);
+            dentry->d_time = jiffies;
+        }
+        dput(dentry);
+        return;
+    }
+    // a cached negative entry is out of date, the listing has the name
+    if (dentry)
+    {
+        d_drop(dentry);
+        dput(dentry);
+    }
+
+    dentry = d_alloc_name(parent, obj->name);
+    if (!dentry)
+        return;
+    dentry->d_time = jiffies;
+    struct inode *inode = pseudonfs_get_inode(parent->d_sb, 0, (obj->info.type == OBJECT_TYPE_DIR ? S_IFDIR : S_IFREG) | 0777, obj->info.inode_n, &obj->info.handle);
+    if (inode)
+    {
+        pseudonfs_set_attrs(inode, &obj->attrs);
+        // a directory already known under another dentry keeps that one
+        struct dentry *alias = d_splice_alias(inode, dentry);
+        if (!IS_ERR_OR_NULL(alias))
+            dput(alias);
     }
+    dput(dentry);
+}
+
 
-    uint32_t off = ctxt->pos;
-    while (off < resp->list.objects.count)
+// reads up to len bytes at offset into a kernel buffer with rsize sized READs, fewer only at the end of the file
+ssize_t pseudonfs_read_data(struct inode *inode, loff_t offset, char *data, size_t len)
+{
+    ServerInfo *info = inode->i_sb->s_fs_info;
+    MethodRequest *req = kmalloc(sizeof(struct MethodRequest), GFP_KERNEL);
+    MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
+    ssize_t ret = 0;
+    if (!req | !resp)
     {
-        Object obj = resp->list.objects.objects[off];
+        ret = -ENOMEM;
+        goto out;
+    }
 
-        dir_emit(ctxt, obj.name, strlen(obj.name), obj.info.inode_n, obj.info.type == OBJECT_TYPE_DIR ? DT_DIR : DT_REG);
-        off++;
-        ctxt->pos++;
+    while (ret < len)
+    {
+        uint32_t chunk = len - ret > info->rsize ? info->rsize : len - ret;
+        memset(req, 0, sizeof(MethodRequest));
+        req->type = METHOD_TYPE_READ;
+        req->read = (ReadRequest) { .inode_n = inode->i_ino, .offset = offset + ret, .length = chunk };
+        pseudonfs_fill_handle(inode, &req->read.handle);
+        if (call_method_data(info, req, 0, resp, data + ret, chunk) < 0)
+        {
+            printk(KERN_ERR "read err\n");
+            ret = -EIO;
+            goto out;
+        }
+        if ((resp->status == METHOD_STATUS_ERR) | (resp->type != METHOD_TYPE_READ))
+        {
+            printk(KERN_ERR "read call err\n");
+            ret = -EIO;
+            goto out;
+        }
+
+        ret += resp->read.length;
+        if (resp->read.length < chunk)
+            break;
     }
 
+    out:
     kfree(req);
     kfree(resp);
-    return off;
+    return ret;
 }
 
 
-ssize_t pseudonfs_read(struct file *f, char *buffer, size_t len, loff_t *off)
+// writes len bytes of a kernel buffer at offset with wsize sized WRITEs
+ssize_t pseudonfs_write_data(struct inode *inode, loff_t offset, const char *data, size_t len)
 {
+    ServerInfo *info = inode->i_sb->s_fs_info;
     MethodRequest *req = kmalloc(sizeof(struct MethodRequest), GFP_KERNEL);
-    memset(req, 0, sizeof(MethodRequest));
-    req->type = METHOD_TYPE_READ;
-    req->read = (ReadRequest) { .inode_n = f->f_inode->i_ino };
     MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
-    if (call_method(f->f_inode->i_sb->s_fs_info, req, resp) < 0)
+    ssize_t ret = 0;
+    if (!req | !resp)
     {
-        printk(KERN_ERR "read err\n");
-        return -1;
+        ret = -ENOMEM;
+        goto out;
     }
-    if ((resp->status == METHOD_STATUS_ERR) | (resp->type != METHOD_TYPE_READ))
+
+    while (ret < len)
     {
-        printk(KERN_ERR "read call err\n");
-        return -1;
+        uint32_t chunk = len - ret > info->wsize ? info->wsize : len - ret;
+        memset(req, 0, sizeof(MethodRequest));
+        req->type = METHOD_TYPE_WRITE;
+        req->write = (WriteRequest) { .inode_n = inode->i_ino, .offset = offset + ret, .length = chunk };
+        pseudonfs_fill_handle(inode, &req->write.handle);
+        if (call_method_data(info, req, data + ret, resp, 0, 0) < 0)
+        {
+            printk(KERN_ERR "write err\n");
+            ret = -EIO;
+            goto out;
+        }
+        if ((resp->status == METHOD_STATUS_ERR) | (resp->type != METHOD_TYPE_WRITE) | (resp->write.length < chunk))
+        {
+            printk(KERN_ERR "write call err\n");
+            ret = -EIO;
+            goto out;
+        }
+
+        pseudonfs_set_written_attrs(inode, &resp->write.attrs);
+        ret += resp->write.length;
     }
 
-    ssize_t ret = 0;
-    while (*off < resp->read.data.length)
+    out:
+    kfree(req);
+    kfree(resp);
+    return ret;
+}
+
+
+int pseudonfs_refresh_attrs(struct inode *inode)
+{
+    MethodRequest *req = kmalloc(sizeof(struct MethodRequest), GFP_KERNEL);
+    MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
+    int res = 0;
+    if (!req | !resp)
     {
-        put_user(resp->read.data.data[*off], buffer + *off);
-        ret++;
-        (*off)++;
+        res = -ENOMEM;
+        goto out;
     }
+
+    memset(req, 0, sizeof(MethodRequest));
+    req->type = METHOD_TYPE_GETATTR;
+    req->getattr = (GetattrRequest) { .inode_n = inode->i_ino };
+    pseudonfs_fill_handle(inode, &req->getattr.handle);
+    if ((call_method(inode->i_sb->s_fs_info, req, resp) < 0) | (resp->status == METHOD_STATUS_ERR) | (resp->type != METHOD_TYPE_GETATTR))
+    {
+        printk(KERN_ERR "getattr call err\n");
+        res = -EIO;
+        goto out;
+    }
+    pseudonfs_set_attrs(inode, &resp->getattr.attrs);
+
+    out:
     kfree(req);
     kfree(resp);
+    return res;
+}
+
+
+// drops pages cached from an older version of the file, dirty ones are written first
+int pseudonfs_revalidate_mapping(struct inode *inode)
+{
+    PseudonfsInode *pinode = PSEUDONFS_I(inode);
+    if (!test_and_clear_bit(PSEUDONFS_INO_INVALID_DATA, &pinode->flags))
+        return 0;
+
+    int res = filemap_write_and_wait(inode->i_mapping);
+    if (res == 0)
+        res = invalidate_inode_pages2(inode->i_mapping);
+    if (res < 0)
+        set_bit(PSEUDONFS_INO_INVALID_DATA, &pinode->flags);
+    return res;
+}
+
+
+// close-to-open: every open asks the server for the attributes, so that changes made
+// elsewhere before it are seen instead of the cached pages. With nocto only expired ones are
+int pseudonfs_file_open(struct inode *inode, struct file *f)
+{
+    ServerInfo *info = inode->i_sb->s_fs_info;
+    bool fresh = !info->cto && pseudonfs_attrs_fresh(inode);
+    metrics_count_cache(&info->metrics, METRICS_CACHE_ATTRS, fresh);
+    if (!fresh)
+    {
+        int res = pseudonfs_refresh_attrs(inode);
+        if (res < 0)
+            return res;
+    }
+    return pseudonfs_revalidate_mapping(inode);
+}
+
+
+ssize_t pseudonfs_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    if (iocb->ki_flags & IOCB_DIRECT)
+        return pseudonfs_direct_read(iocb, to);
+    int res = pseudonfs_revalidate_mapping(file_inode(iocb->ki_filp));
+    if (res < 0)
+        return res;
+    return generic_file_read_iter(iocb, to);
+}
+
+
+// writes only dirty the page cache, writepages sends them later. Past max_dirty bytes
+// dirty on the mount the writer flushes its file before it goes on
+ssize_t pseudonfs_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    if (iocb->ki_flags & IOCB_DIRECT)
+        return pseudonfs_direct_write(iocb, from);
+    struct inode *inode = file_inode(iocb->ki_filp);
+    ServerInfo *info = inode->i_sb->s_fs_info;
+    int res = pseudonfs_revalidate_mapping(inode);
+    if (res < 0)
+        return res;
+
+    ssize_t ret = generic_file_write_iter(iocb, from);
+    if ((ret > 0) && (info->max_dirty > 0) && ((uint64_t) wb_stat(&inode_to_bdi(inode)->wb, WB_RECLAIMABLE) << PAGE_SHIFT > info->max_dirty))
+        filemap_flush(inode->i_mapping);
     return ret;
 }
 
 
-ssize_t pseudonfs_write(struct file *f, const char *buffer, size_t len, loff_t *off)
+// O_DIRECT bypasses the page cache: every rsize chunk is read from the server into one
+// buffer and copied to the caller in one go. Dirty pages of the range are written first
+ssize_t pseudonfs_direct_read(struct kiocb *iocb, struct iov_iter *to)
 {
-    if (len > MAX_DATA_LENGTH)
-        return -1;
+    struct inode *inode = file_inode(iocb->ki_filp);
+    ServerInfo *info = inode->i_sb->s_fs_info;
+    size_t count = iov_iter_count(to);
+    if (count == 0)
+        return 0;
 
-    MethodRequest *req = kmalloc(sizeof(struct MethodRequest), GFP_KERNEL);
-    memset(req, 0, sizeof(MethodRequest));
-    req->type = METHOD_TYPE_WRITE;
-    req->write = (WriteRequest) { .inode_n = f->f_inode->i_ino };
-    req->write.data.length = len;
-    memset(req->write.data.data, 0, MAX_DATA_LENGTH);
+    int res = filemap_write_and_wait_range(inode->i_mapping, iocb->ki_pos, iocb->ki_pos + count - 1);
+    if (res < 0)
+        return res;
+    size_t size = count > info->rsize ? info->rsize : count;
+    char *buf = kvmalloc(size, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
 
     ssize_t ret = 0;
-    while (*off < len)
+    while (iov_iter_count(to) > 0)
     {
-        get_user(req->write.data.data[*off], buffer + *off);
-        ret++;
-        (*off)++;
+        size_t chunk = iov_iter_count(to) > size ? size : iov_iter_count(to);
+        ssize_t got = pseudonfs_read_data(inode, iocb->ki_pos, buf, chunk);
+        if (got < 0)
+        {
+            ret = ret > 0 ? ret : got;
+            break;
+        }
+        size_t copied = copy_to_iter(buf, got, to);
+        iocb->ki_pos += copied;
+        ret += copied;
+        if (copied < (size_t) got)
+        {
+            ret = ret > 0 ? ret : -EFAULT;
+            break;
+        }
+        if ((size_t) got < chunk)
+            break;
     }
+    kvfree(buf);
+    return ret;
+}
 
-    MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
-    if (call_method(f->f_inode->i_sb->s_fs_info, req, resp) < 0)
+
+// the cached pages of the range are written and dropped first, so later buffered reads see the new data
+ssize_t pseudonfs_direct_write(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct file *f = iocb->ki_filp;
+    struct inode *inode = file_inode(f);
+    ServerInfo *info = inode->i_sb->s_fs_info;
+
+    inode_lock(inode);
+    ssize_t ret = generic_write_checks(iocb, from);
+    if (ret <= 0)
+        goto out;
+    size_t count = ret;
+    ret = file_remove_privs(f);
+    if (ret < 0)
+        goto out;
+
+    pgoff_t first = iocb->ki_pos >> PAGE_SHIFT, last = (iocb->ki_pos + count - 1) >> PAGE_SHIFT;
+    ret = filemap_write_and_wait_range(inode->i_mapping, iocb->ki_pos, iocb->ki_pos + count - 1);
+    if (ret == 0)
+        ret = invalidate_inode_pages2_range(inode->i_mapping, first, last);
+    if (ret < 0)
+        goto out;
+
+    size_t size = count > info->wsize ? info->wsize : count;
+    char *buf = kvmalloc(size, GFP_KERNEL);
+    if (!buf)
     {
-        printk(KERN_ERR "write err\n");
-        return -1;
+        ret = -ENOMEM;
+        goto out;
     }
-    if ((resp->status == METHOD_STATUS_ERR) | (resp->type != METHOD_TYPE_WRITE))
+    while (iov_iter_count(from) > 0)
     {
-        printk(KERN_ERR "write call err\n");
-        return -1;
+        size_t chunk = copy_from_iter(buf, iov_iter_count(from) > size ? size : iov_iter_count(from), from);
+        if (chunk == 0)
+        {
+            ret = ret > 0 ? ret : -EFAULT;
+            break;
+        }
+        ssize_t written = pseudonfs_write_data(inode, iocb->ki_pos, buf, chunk);
+        if (written < 0)
+        {
+            ret = ret > 0 ? ret : written;
+            break;
+        }
+        iocb->ki_pos += written;
+        ret += written;
+        if (iocb->ki_pos > i_size_read(inode))
+            i_size_write(inode, iocb->ki_pos);
     }
+    kvfree(buf);
 
-    kfree(req);
-    kfree(resp);
-
+    out:
+    inode_unlock(inode);
+    if (ret > 0)
+        ret = generic_write_sync(iocb, ret);
     return ret;
 }
 
 
+// dirty pages reach the server before close returns, so the next open anywhere sees them
+int pseudonfs_file_flush(struct file *f, fl_owner_t id)
+{
+    if (!(f->f_mode & FMODE_WRITE))
+        return 0;
+    return filemap_write_and_wait(f->f_mapping);
+}
+
+
+int pseudonfs_file_fsync(struct file *f, loff_t start, loff_t end, int datasync)
+{
+    return file_write_and_wait_range(f, start, end);
+}
+
 
+// copies length bytes of buf into the folio, zeroes the rest and marks it uptodate
+void pseudonfs_fill_folio(struct folio *folio, const char *buf, size_t length)
+{
+    for (size_t off = 0; off < length; off += PAGE_SIZE)
+        memcpy_to_page(folio_page(folio, off >> PAGE_SHIFT), 0, buf + off, min_t(size_t, PAGE_SIZE, length - off));
+    if (length < folio_size(folio))
+        folio_zero_segment(folio, length, folio_size(folio));
+    folio_mark_uptodate(folio);
+}
 
-struct dentry * pseudonfs_lookup(struct inode *parent_inode, struct dentry *child_dentry, unsigned int flag)
+
+// the folio is locked by the caller and stays locked
+int pseudonfs_read_folio_data(struct inode *inode, struct folio *folio)
+{
+    char *buf = kvmalloc(folio_size(folio), GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    ssize_t got = pseudonfs_read_data(inode, folio_pos(folio), buf, folio_size(folio));
+    if (got >= 0)
+        pseudonfs_fill_folio(folio, buf, got);
+    kvfree(buf);
+    return got < 0 ? got : 0;
+}
+
+
+int pseudonfs_read_folio(struct file *f, struct folio *folio)
+{
+    int res = pseudonfs_read_folio_data(folio->mapping->host, folio);
+    folio_unlock(folio);
+    return res;
+}
+
+
+// fills the folios of one READ from the workqueue. They are locked until here, which keeps
+// the inode from being evicted, nothing of it is touched after the last unlock
+void pseudonfs_readahead_work(struct work_struct *work)
+{
+    PseudonfsReadahead *ra = container_of(work, PseudonfsReadahead, work);
+    char *buf = kvmalloc(ra->length, GFP_KERNEL);
+    ssize_t got = buf ? pseudonfs_read_data(ra->inode, ra->offset, buf, ra->length) : -ENOMEM;
+
+    // folios are left not uptodate when the READ failed, read_folio tries them again
+    for (uint32_t i = 0; i < ra->folios_count; i++)
+    {
+        struct folio *folio = ra->folios[i];
+        if (got >= 0)
+        {
+            size_t off = folio_pos(folio) - ra->offset;
+            pseudonfs_fill_folio(folio, buf + off, (size_t) got > off ? min_t(size_t, got - off, folio_size(folio)) : 0);
+        }
+        folio_unlock(folio);
+    }
+    kvfree(buf);
+    kfree(ra);
+}
+
+
+// the page cache tracks sequential access per open file and grows the window up to ra_pages,
+// random reads shrink it again. The window is cut into rsize READs that all go out at once,
+// readers wait only on the folios they need
+void pseudonfs_readahead(struct readahead_control *ractl)
+{
+    struct inode *inode = ractl->mapping->host;
+    ServerInfo *info = inode->i_sb->s_fs_info;
+    uint32_t size = info->rsize > PAGE_SIZE ? round_down(info->rsize, PAGE_SIZE) : PAGE_SIZE;
+    PseudonfsReadahead *ra = 0;
+
+    struct folio *folio;
+    while ((folio = readahead_folio(ractl)) != NULL)
+    {
+        if (ra && (ra->length + folio_size(folio) > size))
+        {
+            queue_work(pseudonfs_read_wq, &ra->work);
+            ra = 0;
+        }
+        if (!ra)
+        {
+            ra = kmalloc(struct_size(ra, folios, size >> PAGE_SHIFT), GFP_KERNEL);
+            if (!ra)
+            {
+                folio_unlock(folio);
+                continue;
+            }
+            INIT_WORK(&ra->work, pseudonfs_readahead_work);
+            ra->inode = inode;
+            ra->offset = folio_pos(folio);
+            ra->length = 0;
+            ra->folios_count = 0;
+        }
+        ra->folios[ra->folios_count++] = folio;
+        ra->length += folio_size(folio);
+    }
+    if (ra)
+        queue_work(pseudonfs_read_wq, &ra->work);
+}
+
+
+int pseudonfs_write_begin(struct file *f, struct address_space *mapping, loff_t pos, unsigned len, struct page **pagep, void **fsdata)
+{
+    struct page *page = grab_cache_page_write_begin(mapping, pos >> PAGE_SHIFT);
+    if (!page)
+        return -ENOMEM;
+    *pagep = page;
+    if (PageUptodate(page) | (len == PAGE_SIZE))
+        return 0;
+
+    // the rest of a partly written page comes from the server, unless it is past the end of the file
+    unsigned from = offset_in_page(pos);
+    if (page_offset(page) >= i_size_read(mapping->host))
+    {
+        zero_user_segments(page, 0, from, from + len, PAGE_SIZE);
+        return 0;
+    }
+    int res = pseudonfs_read_folio_data(mapping->host, page_folio(page));
+    if (res < 0)
+    {
+        unlock_page(page);
+        put_page(page);
+    }
+    return res;
+}
+
+
+int pseudonfs_write_end(struct file *f, struct address_space *mapping, loff_t pos, unsigned len, unsigned copied, struct page *page, void *fsdata)
+{
+    struct inode *inode = mapping->host;
+    if (!PageUptodate(page))
+    {
+        // a short copy into a page nobody read is retried, write_begin zeroed around partial ones
+        if ((copied < len) & (len == PAGE_SIZE))
+            copied = 0;
+        else
+        {
+            if (copied < len)
+                zero_user(page, offset_in_page(pos) + copied, len - copied);
+            SetPageUptodate(page);
+        }
+    }
+
+    if (copied > 0)
+    {
+        if (pos + copied > i_size_read(inode))
+            i_size_write(inode, pos + copied);
+        set_page_dirty(page);
+    }
+    unlock_page(page);
+    put_page(page);
+    return copied;
+}
+
+
+// reclaim writes single pages, one WRITE sent straight from the page
+int pseudonfs_writepage(struct page *page, struct writeback_control *wbc)
+{
+    struct inode *inode = page->mapping->host;
+    loff_t size = i_size_read(inode);
+    loff_t pos = page_offset(page);
+    if (pos >= size)
+    {
+        // truncated after it was dirtied, nothing is left to write
+        unlock_page(page);
+        return 0;
+    }
+
+    size_t len = size - pos > PAGE_SIZE ? PAGE_SIZE : size - pos;
+    set_page_writeback(page);
+    unlock_page(page);
+
+    char *kaddr = kmap_local_page(page);
+    ssize_t res = pseudonfs_write_data(inode, pos, kaddr, len);
+    kunmap_local(kaddr);
+    if (res < 0)
+        mapping_set_error(page->mapping, res);
+    end_page_writeback(page);
+    return res < 0 ? res : 0;
+}
+
+
+// sends the batch as one WRITE and ends the writeback of its pages
+int pseudonfs_flush_batch(PseudonfsWriteBatch *batch)
+{
+    if (batch->pages_count == 0)
+        return 0;
+
+    ssize_t res = pseudonfs_write_data(batch->inode, batch->offset, batch->buf, batch->length);
+    for (uint32_t i = 0; i < batch->pages_count; i++)
+    {
+        if (res < 0)
+            mapping_set_error(batch->pages[i]->mapping, res);
+        end_page_writeback(batch->pages[i]);
+    }
+    batch->pages_count = 0;
+    batch->length = 0;
+    return res < 0 ? res : 0;
+}
+
+
+// write_cache_pages hands out dirty pages in index order, runs of them are copied together
+// and go out as one WRITE once the run breaks or reaches wsize
+int pseudonfs_writepage_batch(struct page *page, struct writeback_control *wbc, void *data)
+{
+    PseudonfsWriteBatch *batch = data;
+    loff_t size = i_size_read(batch->inode);
+    loff_t pos = page_offset(page);
+    if (pos >= size)
+    {
+        unlock_page(page);
+        return 0;
+    }
+
+    int res = 0;
+    if ((batch->pages_count > 0) & ((pos != batch->offset + batch->length) | (batch->length + PAGE_SIZE > batch->size)))
+        res = pseudonfs_flush_batch(batch);
+
+    size_t len = size - pos > PAGE_SIZE ? PAGE_SIZE : size - pos;
+    set_page_writeback(page);
+    if (batch->pages_count == 0)
+        batch->offset = pos;
+    memcpy_from_page(batch->buf + batch->length, page, 0, len);
+    batch->length += len;
+    batch->pages[batch->pages_count++] = page;
+    unlock_page(page);
+    return res;
+}
+
+
+int pseudonfs_writepages(struct address_space *mapping, struct writeback_control *wbc)
+{
+    ServerInfo *info = mapping->host->i_sb->s_fs_info;
+    // at least a page, a wsize below it is split up by pseudonfs_write_data
+    uint32_t size = info->wsize > PAGE_SIZE ? round_down(info->wsize, PAGE_SIZE) : PAGE_SIZE;
+    PseudonfsWriteBatch batch = { .inode = mapping->host, .size = size };
+    batch.buf = kvmalloc(size, GFP_KERNEL);
+    batch.pages = kvmalloc_array(size >> PAGE_SHIFT, sizeof(struct page *), GFP_KERNEL);
+    int res = -ENOMEM;
+    if (batch.buf && batch.pages)
+    {
+        res = write_cache_pages(mapping, wbc, pseudonfs_writepage_batch, &batch);
+        int flushed = pseudonfs_flush_batch(&batch);
+        res = res < 0 ? res : flushed;
+    }
+    kvfree(batch.buf);
+    kvfree(batch.pages);
+    return res;
+}
+
+
+
+
+// returns -ENOENT when the server has no such entry and -EIO when it couldn't be asked
+int pseudonfs_lookup_call(struct inode *parent_inode, const struct qstr *name, LookupResponse *found)
 {
     MethodRequest *req = kmalloc(sizeof(struct MethodRequest), GFP_KERNEL);
+    MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
+    int res = 0;
+    if (!req | !resp)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
     memset(req, 0, sizeof(MethodRequest));
     req->type = METHOD_TYPE_LOOKUP;
     req->lookup = (LookupRequest) { .parent_inode_n = parent_inode->i_ino };
-    strcpy(req->lookup.name, child_dentry->d_name.name);
-    MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
+    pseudonfs_fill_handle(parent_inode, &req->lookup.parent_handle);
+    strscpy(req->lookup.name, name->name, MAX_NAME_SIZE);
     if (call_method(parent_inode->i_sb->s_fs_info, req, resp) < 0)
     {
         printk(KERN_ERR "lookup err\n");
-        return 0;
+        res = -EIO;
+        goto out;
     }
     if ((resp->status == METHOD_STATUS_ERR) | (resp->type != METHOD_TYPE_LOOKUP))
     {
-        printk(KERN_ERR "lookup call err\n");
-        return 0;
+        res = -ENOENT;
+        goto out;
     }
-    struct inode *inode = pseudonfs_get_inode(parent_inode->i_sb, 0, (resp->lookup.info.type == OBJECT_TYPE_DIR ? S_IFDIR : S_IFREG) | 0777, resp->lookup.info.inode_n);
-    if (inode)
-        d_add(child_dentry, inode);
+    *found = resp->lookup;
 
+    out:
     kfree(req);
     kfree(resp);
+    return res;
+}
 
-    return child_dentry;
+
+// misses are cached as negative dentries, d_revalidate ages both kinds
+struct dentry * pseudonfs_lookup(struct inode *parent_inode, struct dentry *child_dentry, unsigned int flag)
+{
+    LookupResponse found;
+    int res = pseudonfs_lookup_call(parent_inode, &child_dentry->d_name, &found);
+    child_dentry->d_time = jiffies;
+    if (res == -ENOENT)
+    {
+        d_add(child_dentry, NULL);
+        return NULL;
+    }
+    if (res < 0)
+        return ERR_PTR(res);
+
+    struct inode *inode = pseudonfs_get_inode(parent_inode->i_sb, 0, (found.info.type == OBJECT_TYPE_DIR ? S_IFDIR : S_IFREG) | 0777, found.info.inode_n, &found.info.handle);
+    if (!inode)
+        return ERR_PTR(-ENOMEM);
+    pseudonfs_set_attrs(inode, &found.attrs);
+    return d_splice_alias(inode, child_dentry);
 }
 
 
@@ -181,6 +826,7 @@ int pseudonfs_create(struct user_namespace *u_nmspc, struct inode *parent_inode,
     memset(req, 0, sizeof(MethodRequest));
     req->type = METHOD_TYPE_CREATE;
     req->create = (CreateRequest) { .parent_inode_n = parent_inode->i_ino, .type = OBJECT_TYPE_FILE };
+    pseudonfs_fill_handle(parent_inode, &req->create.parent_handle);
     strcpy(req->create.name, child_dentry->d_name.name);
     MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
     if (call_method(parent_inode->i_sb->s_fs_info, req, resp) < 0)
@@ -194,9 +840,15 @@ int pseudonfs_create(struct user_namespace *u_nmspc, struct inode *parent_inode,
         return -1;
     }
 
-    struct inode *inode = pseudonfs_get_inode(parent_inode->i_sb, 0, S_IFREG | 0777, resp->create.inode_n);
+    // CREATE truncates a file that already existed, whatever was known about it is stale
+    struct inode *inode = pseudonfs_get_inode(parent_inode->i_sb, 0, S_IFREG | 0777, resp->create.inode_n, &resp->create.handle);
     if (inode)
-        d_add(child_dentry, inode);
+    {
+        pseudonfs_expire_attrs(inode);
+        child_dentry->d_time = jiffies;
+        d_instantiate(child_dentry, inode);
+    }
+    pseudonfs_expire_attrs(parent_inode);
     
     kfree(req);
     kfree(resp);
@@ -211,6 +863,7 @@ int pseudonfs_mkdir(struct user_namespace *u_nmspc, struct inode *parent_inode,
     memset(req, 0, sizeof(MethodRequest));
     req->type = METHOD_TYPE_CREATE;
     req->create = (CreateRequest) { .parent_inode_n = parent_inode->i_ino, .type = OBJECT_TYPE_DIR };
+    pseudonfs_fill_handle(parent_inode, &req->create.parent_handle);
     strcpy(req->create.name, child_dentry->d_name.name);
     MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
     if (call_method(parent_inode->i_sb->s_fs_info, req, resp) < 0)
@@ -224,9 +877,13 @@ int pseudonfs_mkdir(struct user_namespace *u_nmspc, struct inode *parent_inode,
         return -1;
     }
 
-    struct inode *inode = pseudonfs_get_inode(parent_inode->i_sb, 0, S_IFDIR | 0777, resp->create.inode_n);
+    struct inode *inode = pseudonfs_get_inode(parent_inode->i_sb, 0, S_IFDIR | 0777, resp->create.inode_n, &resp->create.handle);
     if (inode)
-        d_add(child_dentry, inode);
+    {
+        child_dentry->d_time = jiffies;
+        d_instantiate(child_dentry, inode);
+    }
+    pseudonfs_expire_attrs(parent_inode);
 
     kfree(req);
     kfree(resp);
@@ -241,6 +898,7 @@ int pseudonfs_rmdir(struct inode *parent_inode, struct dentry *child_dentry)
     memset(req, 0, sizeof(MethodRequest));
     req->type = METHOD_TYPE_RMDIR;
     req->rmdir = (RmdirRequest) { .parent_inode_n = parent_inode->i_ino };
+    pseudonfs_fill_handle(parent_inode, &req->rmdir.parent_handle);
     strcpy(req->rmdir.name, child_dentry->d_name.name);
     MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
     if (call_method(parent_inode->i_sb->s_fs_info, req, resp) < 0)
@@ -253,6 +911,9 @@ int pseudonfs_rmdir(struct inode *parent_inode, struct dentry *child_dentry)
         printk(KERN_ERR "rmdir call err\n");
         return -1;
     }
+    clear_nlink(d_inode(child_dentry));
+    child_dentry->d_time = jiffies;
+    pseudonfs_expire_attrs(parent_inode);
 
     kfree(req);
     kfree(resp);
@@ -267,6 +928,8 @@ int pseudonfs_link(struct dentry *old_dentry, struct inode *parent_inode, struct
     memset(req, 0, sizeof(MethodRequest));
     req->type = METHOD_TYPE_LINK;
     req->link = (LinkRequest) { .parent_inode_n = parent_inode->i_ino, .source_inode_n = old_dentry->d_inode->i_ino };
+    pseudonfs_fill_handle(parent_inode, &req->link.parent_handle);
+    pseudonfs_fill_handle(old_dentry->d_inode, &req->link.source_handle);
     strcpy(req->link.name, new_dentry->d_name.name);
     MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
     if (call_method(parent_inode->i_sb->s_fs_info, req, resp) < 0)
@@ -280,6 +943,14 @@ int pseudonfs_link(struct dentry *old_dentry, struct inode *parent_inode, struct
         return -1;
     }
 
+    // the new name refers to the same inode
+    struct inode *inode = d_inode(old_dentry);
+    inc_nlink(inode);
+    ihold(inode);
+    new_dentry->d_time = jiffies;
+    d_instantiate(new_dentry, inode);
+    pseudonfs_expire_attrs(parent_inode);
+
     kfree(req);
     kfree(resp);
     
@@ -293,6 +964,7 @@ int pseudonfs_unlink(struct inode *parent_inode, struct dentry *child_dentry)
     memset(req, 0, sizeof(MethodRequest));
     req->type = METHOD_TYPE_UNLINK;
     req->unlink = (UnlinkRequest) { .parent_inode_n = parent_inode->i_ino };
+    pseudonfs_fill_handle(parent_inode, &req->unlink.parent_handle);
     strcpy(req->unlink.name, child_dentry->d_name.name);
     MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
     if (call_method(parent_inode->i_sb->s_fs_info, req, resp) < 0)
@@ -305,7 +977,13 @@ int pseudonfs_unlink(struct inode *parent_inode, struct dentry *child_dentry)
         printk(KERN_ERR "unlink call err\n");
         return -1;
     }
-    
+
+    // the server tells how many links are left, other names of the file may still use the inode.
+    // At zero the inode leaves the cache once its last user is gone
+    set_nlink(d_inode(child_dentry), resp->unlink.nlink);
+    child_dentry->d_time = jiffies;
+    pseudonfs_expire_attrs(parent_inode);
+
     kfree(req);
     kfree(resp);
 
@@ -315,42 +993,370 @@ int pseudonfs_unlink(struct inode *parent_inode, struct dentry *child_dentry)
 
 
 
+// stat is answered from the inode while its attributes are fresh
+int pseudonfs_getattr(struct user_namespace *u_nmspc, const struct path *path, struct kstat *stat, u32 request_mask, unsigned int flags)
+{
+    struct inode *inode = d_inode(path->dentry);
+    ServerInfo *info = inode->i_sb->s_fs_info;
+    unsigned int sync = flags & AT_STATX_SYNC_TYPE;
+    bool fresh = (sync == AT_STATX_DONT_SYNC) || ((sync != AT_STATX_FORCE_SYNC) && pseudonfs_attrs_fresh(inode));
+    metrics_count_cache(&info->metrics, METRICS_CACHE_ATTRS, fresh);
+    if (!fresh)
+    {
+        int res = pseudonfs_refresh_attrs(inode);
+        if (res < 0)
+            return res;
+    }
+    generic_fillattr(u_nmspc, inode, stat);
+    return 0;
+}
+
+
+// a dentry is trusted for as long as its directory's attributes would be, after
+// that LOOKUP confirms it still names the same object, or still nothing
+int pseudonfs_d_revalidate(struct dentry *dentry, unsigned int flags)
+{
+    ServerInfo *info = dentry->d_sb->s_fs_info;
+    struct dentry *parent = READ_ONCE(dentry->d_parent);
+    struct inode *dir = d_inode_rcu(parent);
+    if (!dir)
+        return flags & LOOKUP_RCU ? -ECHILD : 0;
+    if (time_before(jiffies, READ_ONCE(dentry->d_time) + READ_ONCE(PSEUDONFS_I(dir)->attr_timeo)))
+    {
+        metrics_count_cache(&info->metrics, METRICS_CACHE_DENTRIES, true);
+        return 1;
+    }
+    // counted once the walk drops out of RCU mode and comes back
+    if (flags & LOOKUP_RCU)
+        return -ECHILD;
+    metrics_count_cache(&info->metrics, METRICS_CACHE_DENTRIES, false);
+
+    parent = dget_parent(dentry);
+    LookupResponse found;
+    int res = pseudonfs_lookup_call(d_inode(parent), &dentry->d_name, &found);
+    dput(parent);
+    if ((res < 0) & (res != -ENOENT))
+        return res;
+
+    struct inode *inode = d_inode(dentry);
+    if (!inode)
+    {
+        if (res == 0)
+            return 0;
+        dentry->d_time = jiffies;
+        return 1;
+    }
+    umode_t type = found.info.type == OBJECT_TYPE_DIR ? S_IFDIR : S_IFREG;
+    if ((res < 0) || (inode->i_ino != found.info.inode_n) || ((inode->i_mode & S_IFMT) != type))
+        return 0;
+    pseudonfs_set_attrs(inode, &found.attrs);
+    dentry->d_time = jiffies;
+    return 1;
+}
+
+
+struct inode * pseudonfs_alloc_inode(struct super_block *sb)
+{
+    PseudonfsInode *pinode = alloc_inode_sb(sb, pseudonfs_inode_cachep, GFP_KERNEL);
+    if (!pinode)
+        return NULL;
+    memset(&pinode->attrs, 0, sizeof(ObjectAttrs));
+    pinode->attr_time = 0;
+    pinode->attr_timeo = 0;
+    pinode->flags = 0;
+    return &pinode->vfs_inode;
+}
+
+
+void pseudonfs_free_inode(struct inode *inode)
+{
+    kmem_cache_free(pseudonfs_inode_cachep, PSEUDONFS_I(inode));
+}
+
+
+void pseudonfs_init_once(void *obj)
+{
+    PseudonfsInode *pinode = obj;
+    inode_init_once(&pinode->vfs_inode);
+}
+
+
+void pseudonfs_evict_inode(struct inode *inode)
+{
+    truncate_inode_pages_final(&inode->i_data);
+    clear_inode(inode);
+    kfree(inode->i_private);
+    inode->i_private = 0;
+}
+
+
 void pseudonfs_kill_sb(struct super_block *sb)
 {
     ServerInfo *info = sb->s_fs_info;
     if (info != 0)
+        metrics_unregister(&info->metrics);
+    kill_anon_super(sb);
+    if (info != 0)
+    {
+        connection_pool_clean(&info->pool);
         kfree(info->ip);
+    }
     kfree(info);
     printk(KERN_INFO "killed superblock");
 }
 
 
-struct inode * pseudonfs_get_inode(struct super_block *sb, const struct inode *dir, umode_t mode, int i_ino)
+void pseudonfs_fill_handle(struct inode *inode, Handle *handle)
 {
-    struct inode *inode;
-    inode = new_inode(sb);
-    if (inode != NULL) {
-        inode->i_ino = i_ino;
-        inode->i_op = &pseudonfs_inode_ops;
-        inode->i_fop = &pseudonfs_dir_ops;
-        inode_init_owner(&init_user_ns, inode, dir, mode);
+    if (inode->i_private)
+        memcpy(handle, inode->i_private, sizeof(Handle));
+    else
+        handle->length = 0;
+}
+
+
+// a size or mtime other than the one the cached pages were read at means the file changed
+// on the server. While pages are dirty the local size is ahead of the server's and is kept.
+// Attributes are then trusted for attr_timeo, which starts at the ac*min mount option and
+// doubles up to ac*max for as long as they come back unchanged
+void pseudonfs_set_attrs(struct inode *inode, ObjectAttrs *attrs)
+{
+    PseudonfsInode *pinode = PSEUDONFS_I(inode);
+    ServerInfo *info = inode->i_sb->s_fs_info;
+    bool dirty = mapping_tagged(inode->i_mapping, PAGECACHE_TAG_DIRTY) | mapping_tagged(inode->i_mapping, PAGECACHE_TAG_WRITEBACK);
+    unsigned long timeo_min = (S_ISDIR(inode->i_mode) ? info->acdirmin : info->acregmin) * HZ;
+    unsigned long timeo_max = (S_ISDIR(inode->i_mode) ? info->acdirmax : info->acregmax) * HZ;
+
+    spin_lock(&inode->i_lock);
+    bool changed = (pinode->attrs.size != attrs->size) | (pinode->attrs.mtime_sec != attrs->mtime_sec) | (pinode->attrs.mtime_nsec != attrs->mtime_nsec);
+    if (changed & S_ISREG(inode->i_mode) & (inode->i_mapping->nrpages > 0))
+        set_bit(PSEUDONFS_INO_INVALID_DATA, &pinode->flags);
+    pinode->attrs = *attrs;
+    if (changed | (pinode->attr_timeo < timeo_min))
+        pinode->attr_timeo = timeo_min;
+    else
+        pinode->attr_timeo = pinode->attr_timeo * 2 > timeo_max ? timeo_max : pinode->attr_timeo * 2;
+    pinode->attr_time = jiffies;
+    clear_bit(PSEUDONFS_INO_INVALID_ATTRS, &pinode->flags);
+    spin_unlock(&inode->i_lock);
+
+    if (!dirty || (attrs->size > i_size_read(inode)))
+        i_size_write(inode, attrs->size);
+    inode->i_mtime = (struct timespec64) { .tv_sec = attrs->mtime_sec, .tv_nsec = attrs->mtime_nsec };
+    set_nlink(inode, attrs->nlink);
+}
+
+
+// the attributes a WRITE returns come from our own change, the pages it was sent
+// from stay valid
+void pseudonfs_set_written_attrs(struct inode *inode, ObjectAttrs *attrs)
+{
+    spin_lock(&inode->i_lock);
+    PSEUDONFS_I(inode)->attrs = *attrs;
+    PSEUDONFS_I(inode)->attr_time = jiffies;
+    inode->i_mtime = (struct timespec64) { .tv_sec = attrs->mtime_sec, .tv_nsec = attrs->mtime_nsec };
+    spin_unlock(&inode->i_lock);
+    set_nlink(inode, attrs->nlink);
+}
+
+
+// safe without locks, d_revalidate calls it in RCU walk mode
+bool pseudonfs_attrs_fresh(struct inode *inode)
+{
+    PseudonfsInode *pinode = PSEUDONFS_I(inode);
+    if (test_bit(PSEUDONFS_INO_INVALID_ATTRS, &pinode->flags))
+        return false;
+    return time_before(jiffies, READ_ONCE(pinode->attr_time) + READ_ONCE(pinode->attr_timeo));
+}
+
+
+// after a change made through this mount the next stat asks the server again
+void pseudonfs_expire_attrs(struct inode *inode)
+{
+    set_bit(PSEUDONFS_INO_INVALID_ATTRS, &PSEUDONFS_I(inode)->flags);
+}
+
+
+// server objects are hashed by inode number, a number the server reused for an object of
+// another type gets an inode of its own
+int pseudonfs_inode_test(struct inode *inode, void *data)
+{
+    PseudonfsInodeKey *key = data;
+    return (inode->i_ino == key->i_ino) & ((inode->i_mode & S_IFMT) == (key->mode & S_IFMT));
+}
+
+
+// runs under the inode hash lock, the type has to be there before a concurrent
+// iget5_locked tests the new inode
+int pseudonfs_inode_set(struct inode *inode, void *data)
+{
+    PseudonfsInodeKey *key = data;
+    inode->i_ino = key->i_ino;
+    inode->i_mode = key->mode;
+    return 0;
+}
+
+
+// returns the one inode of the object, set up on first use
+struct inode * pseudonfs_get_inode(struct super_block *sb, const struct inode *dir, umode_t mode, unsigned long i_ino, Handle *handle)
+{
+    PseudonfsInodeKey key = { .i_ino = i_ino, .mode = mode };
+    struct inode *inode = iget5_locked(sb, i_ino, pseudonfs_inode_test, pseudonfs_inode_set, &key);
+    if (!inode || !(inode->i_state & I_NEW))
+        return inode;
+
+    inode->i_op = &pseudonfs_inode_ops;
+    if (S_ISREG(mode))
+    {
+        inode->i_fop = &pseudonfs_file_ops;
+        inode->i_mapping->a_ops = &pseudonfs_aops;
     }
+    else
+        inode->i_fop = &pseudonfs_dir_ops;
+    inode_init_owner(&init_user_ns, inode, dir, mode);
+    // no attributes yet, but dentries below a directory age with its attr_timeo from the start
+    ServerInfo *info = sb->s_fs_info;
+    PSEUDONFS_I(inode)->attr_timeo = (S_ISDIR(mode) ? info->acdirmin : info->acregmin) * HZ;
+    set_bit(PSEUDONFS_INO_INVALID_ATTRS, &PSEUDONFS_I(inode)->flags);
+    if (handle && (handle->length > 0) && (handle->length <= MAX_HANDLE_SIZE))
+        inode->i_private = kmemdup(handle, sizeof(Handle), GFP_KERNEL);
+    unlock_new_inode(inode);
     return inode;
 }
 
 
 int pseudonfs_fill_super(struct super_block *sb, void *data, int silent)
 {
+    ServerInfo *info = data;
+    sb->s_fs_info = info;
+    sb->s_op = &pseudonfs_super_ops;
+    sb->s_d_op = &pseudonfs_dentry_ops;
+    sb->s_maxbytes = MAX_LFS_FILESIZE;
+
+    // nodev mounts share a bdi that never writes back, dirty pages need one of our own
+    int res = super_setup_bdi(sb);
+    if (res < 0)
+        return res;
+
+    // anonymous superblocks all share s_id, the device number tells mounts apart
+    char name[32];
+    snprintf(name, sizeof(name), "%u:%u", MAJOR(sb->s_dev), MINOR(sb->s_dev));
+    metrics_register(&info->metrics, name);
+    sb->s_bdi->ra_pages = info->rasize >> PAGE_SHIFT;
+    sb->s_bdi->io_pages = sb->s_bdi->ra_pages;
+
+    MethodRequest *req = kmalloc(sizeof(struct MethodRequest), GFP_KERNEL);
+    memset(req, 0, sizeof(MethodRequest));
+    req->type = METHOD_TYPE_MOUNT;
+    req->mount = (MountRequest) { .rsize = info->rsize, .wsize = info->wsize };
+    MethodResponse *resp = kmalloc(sizeof(struct MethodResponse), GFP_KERNEL);
+    if ((call_method(sb->s_fs_info, req, resp) < 0) | (resp->status == METHOD_STATUS_ERR) | (resp->type != METHOD_TYPE_MOUNT))
+    {
+        printk(KERN_ERR "mount call err\n");
+        kfree(req);
+        kfree(resp);
+        return -EIO;
+    }
+
+    // the server may lower the transfer sizes we asked for
+    info->rsize = resp->mount.rsize;
+    info->wsize = resp->mount.wsize;
+    printk(KERN_INFO "rsize: %u, wsize: %u\n", info->rsize, info->wsize);
+
     struct inode *inode;
-    inode = pseudonfs_get_inode(sb, NULL, S_IFDIR | 0777, ROOT_DIR_INODE_N);
+    inode = pseudonfs_get_inode(sb, NULL, S_IFDIR | 0777, ROOT_DIR_INODE_N, &resp->mount.handle);
+    kfree(req);
+    kfree(resp);
     sb->s_root = d_make_root(inode);
     if (sb->s_root == NULL) {
-        return -1;
+        return -ENOMEM;
     }
     return 0;
 }
 
 
+int pseudonfs_parse_options(ServerInfo *info, const char *data)
+{
+    info->rsize = MAX_DATA_LENGTH;
+    info->wsize = MAX_DATA_LENGTH;
+    info->rdirplus = true;
+    info->acregmin = PSEUDONFS_ACREGMIN;
+    info->acregmax = PSEUDONFS_ACREGMAX;
+    info->acdirmin = PSEUDONFS_ACDIRMIN;
+    info->acdirmax = PSEUDONFS_ACDIRMAX;
+    info->cto = true;
+    info->max_dirty = 0;
+    info->rasize = PSEUDONFS_RASIZE;
+    info->nconnect = CONNECTION_POOL_SIZE;
+    if (!data)
+        return 0;
+
+    char *options = kstrdup(data, GFP_KERNEL);
+    if (!options)
+        return -ENOMEM;
+
+    int res = 0;
+    char *it = options, *opt;
+    while ((opt = strsep(&it, ",")) != NULL)
+    {
+        if (*opt == 0)
+            continue;
+        char *value = strchr(opt, '=');
+        if (value)
+            *value++ = 0;
+
+        if (!strcmp(opt, "rsize") && value)
+            res = kstrtou32(value, 10, &info->rsize);
+        else if (!strcmp(opt, "wsize") && value)
+            res = kstrtou32(value, 10, &info->wsize);
+        else if (!strcmp(opt, "rdirplus") && !value)
+            info->rdirplus = true;
+        else if (!strcmp(opt, "nordirplus") && !value)
+            info->rdirplus = false;
+        else if (!strcmp(opt, "acregmin") && value)
+            res = kstrtou32(value, 10, &info->acregmin);
+        else if (!strcmp(opt, "acregmax") && value)
+            res = kstrtou32(value, 10, &info->acregmax);
+        else if (!strcmp(opt, "acdirmin") && value)
+            res = kstrtou32(value, 10, &info->acdirmin);
+        else if (!strcmp(opt, "acdirmax") && value)
+            res = kstrtou32(value, 10, &info->acdirmax);
+        else if (!strcmp(opt, "actimeo") && value)
+        {
+            res = kstrtou32(value, 10, &info->acregmin);
+            info->acregmax = info->acdirmin = info->acdirmax = info->acregmin;
+        }
+        else if (!strcmp(opt, "noac") && !value)
+            info->acregmin = info->acregmax = info->acdirmin = info->acdirmax = 0;
+        else if (!strcmp(opt, "cto") && !value)
+            info->cto = true;
+        else if (!strcmp(opt, "nocto") && !value)
+            info->cto = false;
+        else if (!strcmp(opt, "max_dirty") && value)
+            res = kstrtou64(value, 10, &info->max_dirty);
+        else if (!strcmp(opt, "rasize") && value)
+            res = kstrtou32(value, 10, &info->rasize);
+        else if (!strcmp(opt, "nconnect") && value)
+        {
+            res = kstrtou32(value, 10, &info->nconnect);
+            if ((res == 0) && ((info->nconnect == 0) | (info->nconnect > CONNECTION_POOL_MAX_SIZE)))
+                res = -EINVAL;
+        }
+        else
+            res = -EINVAL;
+
+        if (res < 0)
+        {
+            printk(KERN_ERR "bad option %s\n", opt);
+            break;
+        }
+    }
+
+    kfree(options);
+    return res;
+}
+
+
 struct dentry * pseudonfs_mount(struct file_system_type *type, int flags, const char *addr, void *data)
 {
     struct dentry *ret;
@@ -364,25 +1370,41 @@ struct dentry * pseudonfs_mount(struct file_system_type *type, int flags, const
     if (addr[it] == 0)
     {
         printk(KERN_ERR "bad addr\n");
-        return 0;
+        return ERR_PTR(-EINVAL);
     }
 
-    ret = mount_nodev(type, flags, data, pseudonfs_fill_super);
-
-    if (!ret)
-        return 0;
-
-    ret->d_sb->s_fs_info = 0;
-
     ServerInfo *info = kmalloc(sizeof(ServerInfo), GFP_KERNEL);
     info->ip = kmalloc(it + 1, GFP_KERNEL);
     memcpy(info->ip, addr, it);
     info->ip[it] = 0;
 
     if (kstrtou16(addr + it + 1, 10, &info->port) < 0)
+    {
         printk(KERN_ERR "bad port\n");
+        kfree(info->ip);
+        kfree(info);
+        return ERR_PTR(-EINVAL);
+    }
+
+    int res = pseudonfs_parse_options(info, data);
+    if (res < 0)
+    {
+        kfree(info->ip);
+        kfree(info);
+        return ERR_PTR(res);
+    }
+    if (connection_pool_init(&info->pool, info->nconnect) < 0)
+    {
+        kfree(info->ip);
+        kfree(info);
+        return ERR_PTR(-ENOMEM);
+    }
+    metrics_init(&info->metrics);
 
-    ret->d_sb->s_fs_info = (void *) info;
+    // the superblock owns info from here, kill_sb frees it
+    ret = mount_nodev(type, flags, info, pseudonfs_fill_super);
+    if (IS_ERR(ret))
+        return ret;
 
     printk(KERN_INFO "mounted\n");
 
@@ -395,7 +1417,25 @@ struct dentry * pseudonfs_mount(struct file_system_type *type, int flags, const
 int pseudonfs_init(void)
 {
     printk(KERN_INFO "register pseudonfs\n");
-    return register_filesystem(&pseudonfs_fs_type);
+    pseudonfs_inode_cachep = kmem_cache_create("pseudonfs_inode_cache", sizeof(PseudonfsInode), 0, SLAB_RECLAIM_ACCOUNT | SLAB_ACCOUNT, pseudonfs_init_once);
+    if (!pseudonfs_inode_cachep)
+        return -ENOMEM;
+    pseudonfs_read_wq = alloc_workqueue("pseudonfs-read", WQ_UNBOUND, 0);
+    if (!pseudonfs_read_wq)
+    {
+        kmem_cache_destroy(pseudonfs_inode_cachep);
+        return -ENOMEM;
+    }
+    metrics_module_init();
+
+    int res = register_filesystem(&pseudonfs_fs_type);
+    if (res < 0)
+    {
+        metrics_module_exit();
+        destroy_workqueue(pseudonfs_read_wq);
+        kmem_cache_destroy(pseudonfs_inode_cachep);
+    }
+    return res;
 }
 
 
@@ -403,6 +1443,11 @@ void pseudonfs_exit(void)
 {
     printk(KERN_INFO "unregister pseudonfs\n");
     unregister_filesystem(&pseudonfs_fs_type);
+    metrics_module_exit();
+    destroy_workqueue(pseudonfs_read_wq);
+    // inodes are freed after an RCU grace period
+    rcu_barrier();
+    kmem_cache_destroy(pseudonfs_inode_cachep);
 }
 
 
@@ -4,9 +4,17 @@
 #define _GNU_SOURCE
 
 #include <linux/fs.h>
+#include <linux/dcache.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/writeback.h>
+#include <linux/backing-dev.h>
+#include <linux/uio.h>
+#include <linux/workqueue.h>
 #include <linux/slab.h>
 #include <linux/stat.h>
 #include <linux/uaccess.h>
@@ -17,4 +25,67 @@
 #define S_IFDIR 0040000
 #define S_IFREG 0100000
 
+// encoded size asked for in every LIST reply
+#define PSEUDONFS_READDIR_SIZE (16 * 1024)
+
+// attribute cache timeouts in seconds, see pseudonfs_set_attrs
+#define PSEUDONFS_ACREGMIN 3
+#define PSEUDONFS_ACREGMAX 60
+#define PSEUDONFS_ACDIRMIN 30
+#define PSEUDONFS_ACDIRMAX 60
+
+// largest readahead window in bytes, the page cache ramps up to it on sequential reads
+#define PSEUDONFS_RASIZE (8 * 1024 * 1024)
+
+// the server attributes changed since the page cache was filled, it is dropped before the next use
+#define PSEUDONFS_INO_INVALID_DATA 0
+// something was changed through this mount, the attributes are asked for again
+#define PSEUDONFS_INO_INVALID_ATTRS 1
+
+typedef struct PseudonfsInode
+{
+    struct inode vfs_inode;
+    // server attributes the cached pages belong to, under vfs_inode.i_lock
+    ObjectAttrs attrs;
+    // jiffies when attrs were fetched and for how long they are trusted
+    unsigned long attr_time;
+    unsigned long attr_timeo;
+    unsigned long flags;
+} PseudonfsInode;
+
+// a run of dirty pages that goes out as one WRITE, copied into buf in file order
+typedef struct PseudonfsWriteBatch
+{
+    struct inode *inode;
+    char *buf;
+    uint32_t size;
+    loff_t offset;
+    uint32_t length;
+    struct page **pages;
+    uint32_t pages_count;
+} PseudonfsWriteBatch;
+
+// one READ of a readahead window, its folios stay locked until the reply fills them
+typedef struct PseudonfsReadahead
+{
+    struct work_struct work;
+    struct inode *inode;
+    loff_t offset;
+    uint32_t length;
+    uint32_t folios_count;
+    struct folio *folios[];
+} PseudonfsReadahead;
+
+// what iget5_locked matches cached inodes against
+typedef struct PseudonfsInodeKey
+{
+    unsigned long i_ino;
+    umode_t mode;
+} PseudonfsInodeKey;
+
+static inline PseudonfsInode * PSEUDONFS_I(struct inode *inode)
+{
+    return container_of(inode, PseudonfsInode, vfs_inode);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef _BACKEND_H
+#define _BACKEND_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "../shared/protocol.h"
+#include "stats.h"
+
+typedef enum BackendType
+{
+    BACKEND_TYPE_POSIX = 0,
+    BACKEND_TYPE_MEMORY,
+} BackendType;
+
+typedef struct FSOptions
+{
+    BackendType backend;
+    int use_handles;
+    uint32_t fd_cache_size;
+} FSOptions;
+
+// a READ reply is sent from an open fd with sendfile, or from buf when the backend
+// copied the data out. Either way the range goes back to the backend's release
+typedef struct FSRange
+{
+    int fd;
+    off_t offset;
+    uint32_t length;
+    char *buf;
+} FSRange;
+
+// payload that goes along with a request or a reply: WRITEs consume their bytes from buf in order,
+// READs reply with ranges to send so that the data never has to be copied into the reply,
+// except inside a COMPOUND where fs.c copies it before the following ops run
+typedef struct FSData
+{
+    char *buf;
+    uint32_t ranges_count;
+    FSRange ranges[MAX_COMPOUND_OPS];
+} FSData;
+
+typedef struct Backend Backend;
+
+// every engine implements all methods on its own inode numbers, fs.c maps the
+// root to ROOT_DIR_INODE_N and handles COMPOUND on top of them
+typedef struct BackendOps
+{
+    const char *name;
+    int (*create)(Backend *backend, CreateRequest *req, CreateResponse *resp);
+    int (*link)(Backend *backend, LinkRequest *req, LinkResponse *resp);
+    int (*unlink)(Backend *backend, UnlinkRequest *req, UnlinkResponse *resp);
+    int (*read)(Backend *backend, ReadRequest *req, ReadResponse *resp, FSData *data);
+    int (*write)(Backend *backend, WriteRequest *req, WriteResponse *resp, FSData *data);
+    int (*list)(Backend *backend, ListRequest *req, ListResponse *resp);
+    int (*rmdir)(Backend *backend, RmdirRequest *req, RmdirResponse *resp);
+    int (*lookup)(Backend *backend, LookupRequest *req, LookupResponse *resp);
+    int (*mount)(Backend *backend, MountRequest *req, MountResponse *resp);
+    int (*getattr)(Backend *backend, GetattrRequest *req, GetattrResponse *resp);
+    void (*release)(Backend *backend, FSRange *range);
+    void (*clean)(Backend *backend);
+} BackendOps;
+
+// engines embed this as their first member
+struct Backend
+{
+    const BackendOps *ops;
+    __u64 root_inode_n;
+    Stats *stats;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include "fdcache.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+static uint32_t fd_cache_inode_bucket(FdCache *cache, ino_t inode_n)
+{
+    return (uint32_t) (((unsigned long long) inode_n * 0x9E3779B97F4A7C15ULL) >> 17) & (cache->buckets_count - 1);
+}
+
+static uint32_t fd_cache_fd_bucket(FdCache *cache, int fd)
+{
+    return (uint32_t) fd & (cache->buckets_count - 1);
+}
+
+int fd_cache_init(FdCache *cache, uint32_t capacity)
+{
+    cache->buckets_count = 1;
+    while (cache->buckets_count < capacity * 2)
+        cache->buckets_count *= 2;
+    cache->inode_buckets = calloc(cache->buckets_count, sizeof(FdCacheEntry *));
+    cache->fd_buckets = calloc(cache->buckets_count, sizeof(FdCacheEntry *));
+    if (!cache->inode_buckets | !cache->fd_buckets)
+        return -1;
+    cache->count = 0;
+    cache->capacity = capacity;
+    cache->lru_head = 0;
+    cache->lru_tail = 0;
+    if (pthread_mutex_init(&cache->lock, 0) != 0)
+        return -1;
+    return 0;
+}
+
+static void fd_cache_lru_unlink(FdCache *cache, FdCacheEntry *entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        cache->lru_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        cache->lru_tail = entry->lru_prev;
+    entry->lru_prev = 0;
+    entry->lru_next = 0;
+}
+
+static void fd_cache_lru_push(FdCache *cache, FdCacheEntry *entry)
+{
+    entry->lru_prev = 0;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head)
+        cache->lru_head->lru_prev = entry;
+    else
+        cache->lru_tail = entry;
+    cache->lru_head = entry;
+}
+
+static FdCacheEntry * fd_cache_find_locked(FdCache *cache, ino_t inode_n)
+{
+    FdCacheEntry *entry = cache->inode_buckets[fd_cache_inode_bucket(cache, inode_n)];
+    while (entry && (entry->inode_n != inode_n))
+        entry = entry->inode_next;
+    return entry;
+}
+
+static void fd_cache_free_locked(FdCache *cache, FdCacheEntry *entry)
+{
+    FdCacheEntry **it = &cache->fd_buckets[fd_cache_fd_bucket(cache, entry->fd)];
+    while (*it != entry)
+        it = &(*it)->fd_next;
+    *it = entry->fd_next;
+    close(entry->fd);
+    free(entry);
+}
+
+// takes a live entry out of the cache, it is closed now or by its last release
+static void fd_cache_drop_locked(FdCache *cache, FdCacheEntry *entry)
+{
+    FdCacheEntry **it = &cache->inode_buckets[fd_cache_inode_bucket(cache, entry->inode_n)];
+    while (*it != entry)
+        it = &(*it)->inode_next;
+    *it = entry->inode_next;
+    fd_cache_lru_unlink(cache, entry);
+    cache->count--;
+
+    if (entry->refs == 0)
+        fd_cache_free_locked(cache, entry);
+    else
+        entry->stale = 1;
+}
+
+void fd_cache_clean(FdCache *cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    while (cache->lru_head)
+        fd_cache_drop_locked(cache, cache->lru_head);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// returns a referenced fd for inode_n or -1 when it isn't cached
+int fd_cache_get(FdCache *cache, ino_t inode_n)
+{
+    int fd = -1;
+    pthread_mutex_lock(&cache->lock);
+    FdCacheEntry *entry = fd_cache_find_locked(cache, inode_n);
+    if (entry)
+    {
+        entry->refs++;
+        fd_cache_lru_unlink(cache, entry);
+        fd_cache_lru_push(cache, entry);
+        fd = entry->fd;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return fd;
+}
+
+// hands fd over to the cache and returns the fd to use, which is an already cached
+// one if another thread got there first. Without memory fd is returned uncached.
+int fd_cache_put(FdCache *cache, ino_t inode_n, int fd)
+{
+    pthread_mutex_lock(&cache->lock);
+    FdCacheEntry *entry = fd_cache_find_locked(cache, inode_n);
+    if (entry)
+    {
+        entry->refs++;
+        pthread_mutex_unlock(&cache->lock);
+        close(fd);
+        return entry->fd;
+    }
+
+    entry = calloc(1, sizeof(FdCacheEntry));
+    if (!entry)
+    {
+        pthread_mutex_unlock(&cache->lock);
+        return fd;
+    }
+
+    while ((cache->count >= cache->capacity) & (cache->lru_tail != 0))
+        fd_cache_drop_locked(cache, cache->lru_tail);
+
+    entry->inode_n = inode_n;
+    entry->fd = fd;
+    entry->refs = 1;
+    uint32_t bucket = fd_cache_inode_bucket(cache, inode_n);
+    entry->inode_next = cache->inode_buckets[bucket];
+    cache->inode_buckets[bucket] = entry;
+    bucket = fd_cache_fd_bucket(cache, fd);
+    entry->fd_next = cache->fd_buckets[bucket];
+    cache->fd_buckets[bucket] = entry;
+    fd_cache_lru_push(cache, entry);
+    cache->count++;
+
+    pthread_mutex_unlock(&cache->lock);
+    return fd;
+}
+
+// returns 0 if fd doesn't belong to the cache and has to be closed by the caller
+int fd_cache_release(FdCache *cache, int fd)
+{
+    pthread_mutex_lock(&cache->lock);
+    FdCacheEntry *entry = cache->fd_buckets[fd_cache_fd_bucket(cache, fd)];
+    while (entry && (entry->fd != fd))
+        entry = entry->fd_next;
+    int found = entry != 0;
+    if (found)
+    {
+        entry->refs--;
+        if ((entry->refs == 0) & entry->stale)
+            fd_cache_free_locked(cache, entry);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+void fd_cache_invalidate(FdCache *cache, ino_t inode_n)
+{
+    pthread_mutex_lock(&cache->lock);
+    FdCacheEntry *entry = fd_cache_find_locked(cache, inode_n);
+    if (entry)
+        fd_cache_drop_locked(cache, entry);
+    pthread_mutex_unlock(&cache->lock);
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef _FDCACHE_H
+#define _FDCACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define FD_CACHE_DEFAULT_SIZE 1024
+// fds kept free for sockets, listings and files that aren't cached
+#define FD_CACHE_RESERVED_FDS 256
+
+// an fd handed out by fd_cache_get/fd_cache_put stays open until it is released,
+// entries evicted or invalidated while in use are closed by their last release
+typedef struct FdCacheEntry
+{
+    ino_t inode_n;
+    int fd;
+    uint32_t refs;
+    int stale;
+    struct FdCacheEntry *inode_next;
+    struct FdCacheEntry *fd_next;
+    struct FdCacheEntry *lru_prev;
+    struct FdCacheEntry *lru_next;
+} FdCacheEntry;
+
+typedef struct FdCache
+{
+    FdCacheEntry **inode_buckets;
+    FdCacheEntry **fd_buckets;
+    uint32_t buckets_count;
+    uint32_t count;
+    uint32_t capacity;
+    // most recently used first, only live entries
+    FdCacheEntry *lru_head;
+    FdCacheEntry *lru_tail;
+    pthread_mutex_t lock;
+} FdCache;
+
+int fd_cache_init(FdCache *cache, uint32_t capacity);
+void fd_cache_clean(FdCache *cache);
+int fd_cache_get(FdCache *cache, ino_t inode_n);
+int fd_cache_put(FdCache *cache, ino_t inode_n, int fd);
+int fd_cache_release(FdCache *cache, int fd);
+void fd_cache_invalidate(FdCache *cache, ino_t inode_n);
+
+#endif
\ No newline at end of file
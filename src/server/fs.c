@@ -1,580 +1,296 @@
 #include "fs.h"
+#include "posix.h"
+#include "mem.h"
+#include "../shared/wire.h"
 
 #include <stdlib.h>
 #include <errno.h>
 
-extern int errno;
-
-int fs_init(char *path, FS *fs)
+int fs_init(char *path, FSOptions *opts, FS *fs)
 {
-    printf("fs_init %s\n", path);
-    int fd = open(path, 0);
-    if (fd < 0)
-        return -1;
-    
-    struct stat st;
-    if (fstat(fd, &st) < 0)
-        return -1;
-
-    fs->root = fd;
-    fs->root_inode_n = st.st_ino;
-    return 0;
-}
-
-void fs_clean(FS *fs)
-{
-    long n = sysconf(_SC_OPEN_MAX);
-    for (long i = 5; i < n; i++)
-        close(i);
-}
-
-int fs_find_object_by_inode_n_impl(int old_fd, int fd, ino_t inode_n, int *res)
-{
-    if (fd == 0)
-        return -1;
-
-    struct stat st;
-    if (fstat(fd, &st) < 0)
-    {
-        printf("ERR: find_by_inode cant get stat\n");
-        return -1;
-    }
-
-    printf("find_by_inode now in %lu\n", st.st_ino);
-
-    if (st.st_ino == inode_n)
+    stats_init(&fs->stats);
+    switch (opts->backend)
     {
-        printf("find_by_inode found! %lu\n", st.st_ino);
-        *res = fd;
-        return 2;
-    }
-
-    if (S_ISDIR(st.st_mode))
-    {
-        if (fchdir(fd) < 0)
+        case BACKEND_TYPE_POSIX:
         {
-            printf("ERR: find_by_inode cant change dir\n");
-            return -1;
-        }
-
-        DIR *dir = fdopendir(fd);
-        rewinddir(dir);
-        if (!dir)
-        {
-            printf("ERR: find_by_inode cant open dir\n");
-            return -1;
-        }
-
-        struct dirent *ent;
-        while (ent = readdir(dir))
-        {
-            if (strcmp(ent->d_name, ".") & strcmp(ent->d_name, ".."))
-            {
-                int new_fd = open(ent->d_name, O_RDWR, 0);
-                if (new_fd <= 0)
-                {
-                    new_fd = open(ent->d_name, 0);
-                    if (new_fd <= 0)
-                    {
-                        printf("ERR: find_by_inode cant open fd\n");
-                        return -1;
-                    }
-                }
-                int rec = fs_find_object_by_inode_n_impl(fd, new_fd, inode_n, res);
-                if (rec < 0)
-                {
-                    close(new_fd);
-                    rewinddir(dir);
-                    return -1;
-                }
-                else if (rec == 2)
-                {
-                    rewinddir(dir);
-                    return 1;
-                }
-                else if (rec == 1)
-                {
-                    close(new_fd);
-                    rewinddir(dir);
-                    return 1;
-                }
-                close(new_fd);
-            }
+            PosixBackend *posix = malloc(sizeof(PosixBackend));
+            if (!posix || (posix_init(posix, path, opts, &fs->stats) < 0))
+                return -1;
+            fs->backend = &posix->base;
+            break;
         }
-        rewinddir(dir);
-    }
-
-    if (fchdir(old_fd) < 0)
-    {
-        printf("ERR: find_by_inode cant change dir\n");
-        return -1;
-    }
-    return 0;
-}
-
-int fs_find_object_by_inode_n(FS *fs, ino_t inode_n)
-{
-    printf("find: %lu, root: %d\n", inode_n, fs->root);
-    int res = 0;
-    if (fs_find_object_by_inode_n_impl(fs->root, fs->root, inode_n, &res) < 0)
-        return -1;
-    printf("find: found: %d\n", res);
-    return res;
-}
-
-int fs_find_parent_dir_and_name_by_inode_n_impl(FS *fs, int old_fd, int fd, ino_t inode_n, char **name, int *res)
-{
-    if (fd == 0)
-        return -1;
-
-    struct stat st;
-    if (fstat(fd, &st) < 0)
-    {
-        printf("ERR: find_parent_by_inode cant get stat\n");
-        return -1;
-    }
-
-    printf("find_parent_by_inode now in %lu\n", st.st_ino);
-
-    if (S_ISDIR(st.st_mode))
-    {
-        if (fchdir(fd) < 0)
+        case BACKEND_TYPE_MEMORY:
         {
-            printf("ERR: find_parent_by_inode cant change dir\n");
-            return -1;
+            MemBackend *mem = malloc(sizeof(MemBackend));
+            if (!mem || (mem_init(mem, &fs->stats) < 0))
+                return -1;
+            fs->backend = &mem->base;
+            break;
         }
-
-        DIR *dir = fdopendir(fd);
-        rewinddir(dir);
-        if (!dir)
-        {
-            printf("ERR: find_parent_by_inode cant open dir\n");
+        default:
             return -1;
-        }
-
-        struct dirent *ent;
-        while (ent = readdir(dir))
-        {
-            if (strcmp(ent->d_name, ".") & strcmp(ent->d_name, ".."))
-            {
-                int new_fd = open(ent->d_name, O_RDWR, 0);
-                if (new_fd <= 0)
-                {
-                    new_fd = open(ent->d_name, 0);
-                    if (new_fd <= 0)
-                    {
-                        printf("ERR: find_parent_by_inode cant open fd\n");
-                        return -1;
-                    }
-                }
-                struct stat new_st;
-                if (fstat(new_fd, &new_st) < 0)
-                {
-                    printf("ERR: find_parent_by_inode cant get new stat\n");
-                    return -1;
-                }
-
-                if (new_st.st_ino == inode_n)
-                {
-                    *res = fd;
-                    *name = malloc(strlen(ent->d_name) + 1);
-                    memcpy(*name, ent->d_name, strlen(ent->d_name));
-                    (*name)[strlen(ent->d_name)] = 0;
-                    close(new_fd);
-                    rewinddir(dir);
-                    return 2;
-                }
-
-                int rec = fs_find_object_by_inode_n_impl(fd, new_fd, inode_n, res);
-                if (rec < 0)
-                {
-                    close(new_fd);
-                    rewinddir(dir);
-                    return -1;
-                }
-                else if (rec == 2)
-                {
-                    rewinddir(dir);
-                    return 1;
-                }
-                else if (rec == 1)
-                {
-                    close(new_fd);
-                    rewinddir(dir);
-                    return 1;
-                }
-                close(new_fd);
-            }
-        }
-        rewinddir(dir);
-    }
-
-    if (fchdir(old_fd) < 0)
-    {
-        printf("ERR: find_parent_by_inode cant change dir\n");
-        return -1;
     }
+    LOG_INFO("fs_init: %s backend", fs->backend->ops->name);
     return 0;
 }
 
-int fs_find_parent_dir_and_name_by_inode_n(FS *fs, ino_t inode_n, char **name)
+void fs_clean(FS *fs)
 {
-    printf("find parent: %lu, root: %d\n", inode_n, fs->root);
-    int res = 0;
-    if (fs_find_parent_dir_and_name_by_inode_n_impl(fs, fs->root, fs->root, inode_n, name, &res) < 0)
-        return -1;
-    printf("find parent: %d, name: %s\n", res, *name);
-    return res;
+    fs->backend->ops->clean(fs->backend);
+    free(fs->backend);
 }
 
-int fs_handle_create(FS *fs, CreateRequest *req, CreateResponse *resp)
+void fs_release(FS *fs, FSRange *range)
 {
-    printf("create\n");
-    int parent_fd = fs_find_object_by_inode_n(fs, req->parent_inode_n);
-    if (parent_fd <= 0)
-        return -1;
-    
-    if (fchdir(parent_fd) < 0)
-        return -1;
-
-    int fd;
-    struct stat st;
-
-    switch (req->type)
-    {
-        case OBJECT_TYPE_FILE:
-            fd = creat(req->name, 0777);
-            if (fd < 0)
-                return -1;
-            if (fchmod(fd, 0777) < 0)
-                return -1;
-            if (fstat(fd, &st) < 0)
-                return -1;
-            resp->inode_n = st.st_ino;
-            break;
-        
-        case OBJECT_TYPE_DIR:
-            if (mkdir(req->name, 0777) < 0)
-                return -1;
-            fd = open(req->name, 0);
-            if (fd < 0)
-                return -1;
-            if (fchmod(fd, 0777) < 0)
-                return -1;
-            if (fstat(fd, &st) < 0)
-                return -1;
-            resp->inode_n = st.st_ino;
-            break;
-    }
-    printf("create: inode_n: %lu\n", resp->inode_n);
-    if (fd != fs->root)
-        close(fd);
-    if (parent_fd != fs->root)
-        close(parent_fd);
-    return 0;
+    fs->backend->ops->release(fs->backend, range);
 }
 
-int fs_handle_link(FS *fs, LinkRequest *req, LinkResponse *resp)
+int fs_handle_mount(FS *fs, MountRequest *req, MountResponse *resp)
 {
-    printf("link\n");
-
-    int parent_fd = fs_find_object_by_inode_n(fs, req->parent_inode_n);
-    if (parent_fd <= 0)
+    if (fs->backend->ops->mount(fs->backend, req, resp) < 0)
         return -1;
 
-    char *source_name = 0;
-
-    int source_parent_fd = fs_find_parent_dir_and_name_by_inode_n(fs, req->source_inode_n, &source_name);
-    if ((source_parent_fd <= 0) | (source_name == 0))
-        return -1;
-
-    printf("link: name: %s, source_name: %s, source_parent_fd: %d\n", req->name, source_name, source_parent_fd);
-
-    if (linkat(source_parent_fd, source_name, parent_fd, req->name, 0) < 0)
-    {
-        printf("ERR (link): can't linkat\n");
-        return -1;
-    }
-    
-    if (parent_fd != fs->root)
-        close(parent_fd);
-    if (source_parent_fd != fs->root)
-        close(source_parent_fd);
-    free(source_name);
+    // 0 lets the server pick its maximum
+    resp->rsize = ((req->rsize == 0) | (req->rsize > MAX_DATA_LENGTH)) ? MAX_DATA_LENGTH : req->rsize;
+    resp->wsize = ((req->wsize == 0) | (req->wsize > MAX_DATA_LENGTH)) ? MAX_DATA_LENGTH : req->wsize;
+    LOG_DEBUG("mount: %llu, rsize: %u, wsize: %u", resp->inode_n, resp->rsize, resp->wsize);
     return 0;
 }
 
-int fs_handle_unlink(FS *fs, UnlinkRequest *req, UnlinkResponse *resp)
+// the client knows the root as ROOT_DIR_INODE_N, the backend by its own number
+void fs_map_in(FS *fs, __u64 *inode_n)
 {
-    printf("unlink\n");
-    int parent_fd = fs_find_object_by_inode_n(fs, req->parent_inode_n);
-    if (parent_fd <= 0)
-        return -1;
-
-    if (fchdir(parent_fd) < 0)
-        return -1;
-    
-    unlink(req->name);
-    if (parent_fd != fs->root)
-        close(parent_fd);
-    return 0;
+    if (*inode_n == ROOT_DIR_INODE_N)
+        *inode_n = fs->backend->root_inode_n;
 }
 
-int fs_handle_read(FS *fs, ReadRequest *req, ReadResponse *resp)
+void fs_map_out(FS *fs, __u64 *inode_n)
 {
-    printf("read\n");
-    int fd = fs_find_object_by_inode_n(fs, req->inode_n);
-    if (fd <= 0)
-    {
-        printf("ERR (read): cant find fd\n");
-        return -1;
-    }
-
-    memset(resp->data.data, 0, MAX_DATA_LENGTH);
-
-    resp->data.length = read(fd, resp->data.data, MAX_DATA_LENGTH);
-    if (resp->data.length < 0)
-    {
-        printf("ERR (read): cant read\n");
-        return -1;
-    }
-
-    printf("read: %d, %s\n", resp->data.length, resp->data.data);
-    
-    if (fd != fs->root)
-        close(fd);
-    return 0;
+    if (*inode_n == fs->backend->root_inode_n)
+        *inode_n = ROOT_DIR_INODE_N;
 }
 
-int fs_handle_write(FS *fs, WriteRequest *req, WriteResponse *resp)
+// replaces a reference to the result of an earlier op with the object it produced
+int fs_compound_resolve(CompoundResponse *resp, uint32_t current, __u64 *inode_n, Handle *handle)
 {
-    printf("write\n");
-    int fd = fs_find_object_by_inode_n(fs, req->inode_n);
-    if (fd <= 0)
-    {
-        printf("ERR (write): cant find fd\n");
+    int op = compound_result_op(*inode_n);
+    if (op < 0)
+        return 0;
+    if ((uint32_t) op >= current)
         return -1;
-    }
 
-    struct stat st;
-    if (fstat(fd, &st) < 0)
+    CompoundOpResponse *result = &resp->ops[op];
+    if (result->type == METHOD_TYPE_CREATE)
     {
-        printf("ERR (write): cant get stat\n");
-        return -1;
+        *inode_n = result->create.inode_n;
+        *handle = result->create.handle;
+        return 0;
     }
-
-    printf("write: len: %d, fd: %d, ino: %lu, data: %s\n", req->data.length, fd, st.st_ino, req->data.data);
-
-    if (write(fd, req->data.data, req->data.length) < 0)
+    if (result->type == METHOD_TYPE_LOOKUP)
     {
-        printf("ERR (write): cant write %s\n", strerror(errno));
-        return -1;
+        *inode_n = result->lookup.info.inode_n;
+        *handle = result->lookup.info.handle;
+        return 0;
     }
-    
-    if (fd != fs->root)
-        close(fd);
-    return 0;
+    return -1;
 }
 
-int fs_handle_list(FS *fs, ListRequest *req, ListResponse *resp)
+// a later op of the same COMPOUND can change the file before the reply is sent,
+// so the data of its READs is copied out while the op runs instead of sent from the fd
+int fs_copy_range(FS *fs, FSRange *range)
 {
-    printf("list\n");
-    int fd = fs_find_object_by_inode_n(fs, req->inode_n);
-    printf("list found fd\n");
-    if (fd <= 0)
-        return -1;
-    
-    if (fchdir(fd) < 0)
+    if (range->buf)
+        return 0;
+    char *buf = malloc(range->length + 1);
+    if (!buf)
         return -1;
-    
-    DIR *dir = fdopendir(fd);
-    if (!dir)
-        return -1;
-    
-    struct dirent *ent;
-    resp->objects.count = 0;
-    while (ent = readdir(dir))
+    uint32_t done = 0;
+    while (done < range->length)
     {
-        if (strcmp(ent->d_name, ".") & strcmp(ent->d_name, ".."))
+        ssize_t len = pread(range->fd, buf + done, range->length - done, range->offset + done);
+        if (len < 0)
         {
-            ObjectType type;
-            if (ent->d_type == DT_DIR)
-                type = OBJECT_TYPE_DIR;
-            else
-                type = OBJECT_TYPE_FILE;
-
-            resp->objects.objects[resp->objects.count].info = (ObjectInfo) { .inode_n = ent->d_ino, .type = type };
-            strcpy(resp->objects.objects[resp->objects.count].name, ent->d_name);
-            resp->objects.count++;
-            if (resp->objects.count >= MAX_OBJECTS_COUNT)
-                return -1;
+            if (errno == EINTR)
+                continue;
+            free(buf);
+            return -1;
         }
+        // the file shrank since the length was set, pad like sendfile_some does
+        if (len == 0)
+        {
+            memset(buf + done, 0, range->length - done);
+            break;
+        }
+        done += len;
     }
-
-
-    printf("list: %d objects\n", resp->objects.count);
-
-    if (fd != fs->root)
-    {
-        closedir(dir);
-    }
-    else
-    {
-        rewinddir(dir);
-    }
+    fs_release(fs, range);
+    range->fd = -1;
+    range->buf = buf;
     return 0;
 }
 
-int fs_handle_rmdir(FS *fs, RmdirRequest *req, RmdirResponse *resp)
+int fs_handle_compound_op(FS *fs, CompoundRequest *req, CompoundResponse *resp, uint32_t i, uint32_t *data_left, FSData *data)
 {
-    printf("rmdir\n");
-    int parent_fd = fs_find_object_by_inode_n(fs, req->parent_inode_n);
-    if (parent_fd <= 0)
-        return -1;
-
-    if (fchdir(parent_fd) < 0)
-        return -1;
-
-    printf("rmdir: name: %s, parent_ino: %d\n", req->name, parent_fd);
-
-    if (rmdir(req->name) < 0)
-        return -1;
-    
-    if (parent_fd != fs->root)
-        close(parent_fd);
-    return 0;
-}
-
-int fs_handle_lookup(FS *fs, LookupRequest *req, LookupResponse *resp)
-{
-    printf("lookup: %s\n", req->name);
-    int parent_fd = fs_find_object_by_inode_n(fs, req->parent_inode_n);
-    if (parent_fd <= 0)
-    {
-        printf("ERR: lookup not found parent dir\n");
-        return -1;
-    }
-
-    if (fchdir(parent_fd) < 0)
+    CompoundOpRequest *op = &req->ops[i];
+    CompoundOpResponse *op_resp = &resp->ops[i];
+    int res = -1;
+    switch (op->type)
     {
-        printf("ERR: lookup cant chdir\n");
-        return -1;
+        case METHOD_TYPE_CREATE:
+            if (fs_compound_resolve(resp, i, &op->create.parent_inode_n, &op->create.parent_handle) < 0)
+                break;
+            fs_map_in(fs, &op->create.parent_inode_n);
+            res = fs->backend->ops->create(fs->backend, &op->create, &op_resp->create);
+            fs_map_out(fs, &op_resp->create.inode_n);
+            break;
+        case METHOD_TYPE_LINK:
+            if ((fs_compound_resolve(resp, i, &op->link.source_inode_n, &op->link.source_handle) < 0)
+                || (fs_compound_resolve(resp, i, &op->link.parent_inode_n, &op->link.parent_handle) < 0))
+                break;
+            fs_map_in(fs, &op->link.source_inode_n);
+            fs_map_in(fs, &op->link.parent_inode_n);
+            res = fs->backend->ops->link(fs->backend, &op->link, &op_resp->link);
+            break;
+        case METHOD_TYPE_UNLINK:
+            if (fs_compound_resolve(resp, i, &op->unlink.parent_inode_n, &op->unlink.parent_handle) < 0)
+                break;
+            fs_map_in(fs, &op->unlink.parent_inode_n);
+            res = fs->backend->ops->unlink(fs->backend, &op->unlink, &op_resp->unlink);
+            break;
+        case METHOD_TYPE_READ:
+            if (fs_compound_resolve(resp, i, &op->read.inode_n, &op->read.handle) < 0)
+                break;
+            fs_map_in(fs, &op->read.inode_n);
+            // all reads of a COMPOUND share one reply's worth of data
+            if (op->read.length > *data_left)
+                op->read.length = *data_left;
+            res = fs->backend->ops->read(fs->backend, &op->read, &op_resp->read, data);
+            if ((res == 0) && (fs_copy_range(fs, &data->ranges[data->ranges_count - 1]) < 0))
+            {
+                fs_release(fs, &data->ranges[--data->ranges_count]);
+                res = -1;
+            }
+            if (res == 0)
+                *data_left -= op_resp->read.length;
+            break;
+        case METHOD_TYPE_WRITE:
+            if (fs_compound_resolve(resp, i, &op->write.inode_n, &op->write.handle) < 0)
+                break;
+            fs_map_in(fs, &op->write.inode_n);
+            res = fs->backend->ops->write(fs->backend, &op->write, &op_resp->write, data);
+            break;
+        case METHOD_TYPE_RMDIR:
+            if (fs_compound_resolve(resp, i, &op->rmdir.parent_inode_n, &op->rmdir.parent_handle) < 0)
+                break;
+            fs_map_in(fs, &op->rmdir.parent_inode_n);
+            res = fs->backend->ops->rmdir(fs->backend, &op->rmdir, &op_resp->rmdir);
+            break;
+        case METHOD_TYPE_LOOKUP:
+            if (fs_compound_resolve(resp, i, &op->lookup.parent_inode_n, &op->lookup.parent_handle) < 0)
+                break;
+            fs_map_in(fs, &op->lookup.parent_inode_n);
+            res = fs->backend->ops->lookup(fs->backend, &op->lookup, &op_resp->lookup);
+            fs_map_out(fs, &op_resp->lookup.info.inode_n);
+            break;
     }
+    return res;
+}
 
-    int fd = open(req->name, 0);
-    if (fd <= 0)
-    {
-        printf("ERR: lookup cant open\n");
-        return -1;
-    }
-    
-    struct stat st;
-    if (fstat(fd, &st) < 0)
+int fs_handle_compound(FS *fs, CompoundRequest *req, CompoundResponse *resp, FSData *data)
+{
+    LOG_DEBUG("compound: %u ops", req->count);
+    uint32_t data_left = MAX_DATA_LENGTH;
+    resp->count = 0;
+    for (uint32_t i = 0; i < req->count; i++)
     {
-        printf("ERR: lookup cant get stat\n");
-        return -1;
+        resp->ops[i].type = req->ops[i].type;
+        resp->count++;
+        if (fs_handle_compound_op(fs, req, resp, i, &data_left, data) < 0)
+        {
+            LOG_ERROR("compound: op %u failed", i);
+            resp->ops[i].status = METHOD_STATUS_ERR;
+            return -1;
+        }
+        resp->ops[i].status = METHOD_STATUS_OK;
     }
-
-    ObjectType type;
-    if (S_ISDIR(st.st_mode))
-        type = OBJECT_TYPE_DIR;
-    else
-        type = OBJECT_TYPE_FILE;
-    
-    resp->info = (ObjectInfo) { .inode_n = st.st_ino, .type = type };
-
-
-    printf("lookup: %lu\n", resp->info.inode_n);
-    if (parent_fd != fs->root)
-        close(parent_fd);
-    if (fd != fs->root)
-        close(fd);
     return 0;
 }
 
-int fs_handle_mount(FS *fs, MountRequest *req, MountResponse *resp)
+int fs_handle_stats(FS *fs, StatsResponse *resp)
 {
-    printf("mount\n");
-    struct stat st;
-    if (fstat(fs->root, &st) < 0)
-        return -1;
-    
-    resp->inode_n = st.st_ino;
-    printf("mount: %lu\n", resp->inode_n);
-
+    stats_snapshot(&fs->stats, resp);
     return 0;
 }
 
-void fs_handle(FS *fs, MethodRequest *req, MethodResponse *resp)
+// data holds the WRITE payload, or receives the READ payload (up to MAX_DATA_LENGTH bytes)
+void fs_handle(FS *fs, MethodRequest *req, MethodResponse *resp, FSData *data)
 {
-    printf("\n----------\n");
-    printf("fs_handle\n");
+    LOG_DEBUG("fs_handle: type %u, xid %u", req->type, req->xid);
+    uint64_t start = stats_now();
+    stats_take_resolve();
     int res = 0;
     resp->type = req->type;
+    resp->xid = req->xid;
     switch (req->type)
     {
         case METHOD_TYPE_CREATE:
-            if (req->create.parent_inode_n == ROOT_DIR_INODE_N)
-                req->create.parent_inode_n = fs->root_inode_n;
-            res = fs_handle_create(fs, &req->create, &resp->create);
-            if (resp->create.inode_n == fs->root_inode_n)
-                resp->create.inode_n = ROOT_DIR_INODE_N;
+            fs_map_in(fs, &req->create.parent_inode_n);
+            res = fs->backend->ops->create(fs->backend, &req->create, &resp->create);
+            fs_map_out(fs, &resp->create.inode_n);
             break;
         case METHOD_TYPE_LINK:
-            if (req->link.parent_inode_n == ROOT_DIR_INODE_N)
-                req->link.parent_inode_n = fs->root_inode_n;
-            if (req->link.source_inode_n == ROOT_DIR_INODE_N)
-                req->link.source_inode_n = fs->root_inode_n;
-            res = fs_handle_link(fs, &req->link, &resp->link);
+            fs_map_in(fs, &req->link.parent_inode_n);
+            fs_map_in(fs, &req->link.source_inode_n);
+            res = fs->backend->ops->link(fs->backend, &req->link, &resp->link);
             break;
         case METHOD_TYPE_UNLINK:
-            if (req->unlink.parent_inode_n == ROOT_DIR_INODE_N)
-                req->unlink.parent_inode_n = fs->root_inode_n;
-            res = fs_handle_unlink(fs, &req->unlink, &resp->unlink);
+            fs_map_in(fs, &req->unlink.parent_inode_n);
+            res = fs->backend->ops->unlink(fs->backend, &req->unlink, &resp->unlink);
             break;
         case METHOD_TYPE_READ:
-            if (req->read.inode_n == ROOT_DIR_INODE_N)
-                req->read.inode_n = fs->root_inode_n;
-            res = fs_handle_read(fs, &req->read, &resp->read);
+            fs_map_in(fs, &req->read.inode_n);
+            res = fs->backend->ops->read(fs->backend, &req->read, &resp->read, data);
             break;
         case METHOD_TYPE_WRITE:
-            if (req->write.inode_n == ROOT_DIR_INODE_N)
-                req->write.inode_n = fs->root_inode_n;
-            res = fs_handle_write(fs, &req->write, &resp->write);
+            fs_map_in(fs, &req->write.inode_n);
+            res = fs->backend->ops->write(fs->backend, &req->write, &resp->write, data);
             break;
         case METHOD_TYPE_LIST:
-            if (req->list.inode_n == ROOT_DIR_INODE_N)
-                req->list.inode_n = fs->root_inode_n;
-            res = fs_handle_list(fs, &req->list, &resp->list);
-            for (uint16_t i=0; i<resp->list.objects.count; i++)
-            {
-                if (resp->list.objects.objects[i].info.inode_n == fs->root_inode_n)
-                    resp->list.objects.objects[i].info.inode_n = ROOT_DIR_INODE_N;
-            }
+            fs_map_in(fs, &req->list.inode_n);
+            res = fs->backend->ops->list(fs->backend, &req->list, &resp->list);
+            for (uint16_t i = 0; i < resp->list.objects.count; i++)
+                fs_map_out(fs, &resp->list.objects.objects[i].info.inode_n);
             break;
         case METHOD_TYPE_RMDIR:
-            if (req->rmdir.parent_inode_n == ROOT_DIR_INODE_N)
-                req->rmdir.parent_inode_n = fs->root_inode_n;
-            res = fs_handle_rmdir(fs, &req->rmdir, &resp->rmdir);
+            fs_map_in(fs, &req->rmdir.parent_inode_n);
+            res = fs->backend->ops->rmdir(fs->backend, &req->rmdir, &resp->rmdir);
             break;
         case METHOD_TYPE_LOOKUP:
-            if (req->lookup.parent_inode_n == ROOT_DIR_INODE_N)
-                req->lookup.parent_inode_n = fs->root_inode_n;
-            res = fs_handle_lookup(fs, &req->lookup, &resp->lookup);
-            if (resp->lookup.info.inode_n == fs->root_inode_n)
-                resp->lookup.info.inode_n = ROOT_DIR_INODE_N;
+            fs_map_in(fs, &req->lookup.parent_inode_n);
+            res = fs->backend->ops->lookup(fs->backend, &req->lookup, &resp->lookup);
+            fs_map_out(fs, &resp->lookup.info.inode_n);
             break;
         case METHOD_TYPE_MOUNT:
             res = fs_handle_mount(fs, &req->mount, &resp->mount);
-            if (resp->mount.inode_n == fs->root_inode_n)
-                resp->mount.inode_n = ROOT_DIR_INODE_N;
+            fs_map_out(fs, &resp->mount.inode_n);
+            break;
+        case METHOD_TYPE_COMPOUND:
+            res = fs_handle_compound(fs, &req->compound, &resp->compound, data);
+            break;
+        case METHOD_TYPE_STATS:
+            res = fs_handle_stats(fs, &resp->stats);
+            break;
+        case METHOD_TYPE_GETATTR:
+            fs_map_in(fs, &req->getattr.inode_n);
+            res = fs->backend->ops->getattr(fs->backend, &req->getattr, &resp->getattr);
             break;
     }
     if (res < 0)
         resp->status = METHOD_STATUS_ERR;
     else
         resp->status = METHOD_STATUS_OK;
-    
-    fchdir(fs->root);
-    printf("----------\n");
+
+    // READ data is sent after this returns, its time isn't part of the handler
+    uint64_t bytes = method_request_data_length(req) + method_response_data_length(resp);
+    stats_record(&fs->stats, req->type, res < 0, bytes, stats_now() - start, stats_take_resolve());
 }
\ No newline at end of file
@@ -14,17 +14,19 @@
 #define uint32_t uint32_t
 
 #include "../shared/protocol.h"
-
-#define MAX_PATH_SIZE 1024
+#include "backend.h"
+#include "stats.h"
+#include "log.h"
 
 typedef struct FS
 {
-    int root;
-    ino_t root_inode_n;
+    Backend *backend;
+    Stats stats;
 } FS;
 
-int fs_init(char *path, FS *fs);
+int fs_init(char *path, FSOptions *opts, FS *fs);
 void fs_clean(FS *fs);
-void fs_handle(FS *fs, MethodRequest *req, MethodResponse *resp);
+void fs_release(FS *fs, FSRange *range);
+void fs_handle(FS *fs, MethodRequest *req, MethodResponse *resp, FSData *data);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,490 @@
+#define _GNU_SOURCE
+
+#include "index.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static size_t index_bucket(size_t buckets_count, ino_t inode_n)
+{
+    return (size_t) (((unsigned long long) inode_n * 0x9E3779B97F4A7C15ULL) >> 17) & (buckets_count - 1);
+}
+
+static uint64_t index_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void index_free_entry(IndexEntry *entry)
+{
+    free(entry->name);
+    free(entry);
+}
+
+static int index_table_init(IndexTable *table, size_t buckets_count)
+{
+    table->buckets = calloc(buckets_count, sizeof(IndexEntry *));
+    if (!table->buckets)
+        return -1;
+    table->buckets_count = buckets_count;
+    table->count = 0;
+    return 0;
+}
+
+static void index_table_clean(IndexTable *table)
+{
+    for (size_t i = 0; i < table->buckets_count; i++)
+    {
+        IndexEntry *entry = table->buckets[i];
+        while (entry)
+        {
+            IndexEntry *next = entry->next;
+            index_free_entry(entry);
+            entry = next;
+        }
+        table->buckets[i] = 0;
+    }
+    table->count = 0;
+}
+
+static int index_table_grow(IndexTable *table)
+{
+    size_t new_buckets_count = table->buckets_count * 2;
+    IndexEntry **new_buckets = calloc(new_buckets_count, sizeof(IndexEntry *));
+    if (!new_buckets)
+        return -1;
+
+    for (size_t i = 0; i < table->buckets_count; i++)
+    {
+        IndexEntry *entry = table->buckets[i];
+        while (entry)
+        {
+            IndexEntry *next = entry->next;
+            size_t bucket = index_bucket(new_buckets_count, entry->inode_n);
+            entry->next = new_buckets[bucket];
+            new_buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    free(table->buckets);
+    table->buckets = new_buckets;
+    table->buckets_count = new_buckets_count;
+    return 0;
+}
+
+static IndexEntry * index_table_get(IndexTable *table, ino_t inode_n)
+{
+    IndexEntry *entry = table->buckets[index_bucket(table->buckets_count, inode_n)];
+    while (entry)
+    {
+        if (entry->inode_n == inode_n)
+            return entry;
+        entry = entry->next;
+    }
+    return 0;
+}
+
+static int index_table_put(IndexTable *table, ino_t inode_n, ino_t parent_inode_n, const char *name)
+{
+    IndexEntry *entry = index_table_get(table, inode_n);
+    if (entry)
+    {
+        if ((entry->parent_inode_n == parent_inode_n) && !strcmp(entry->name, name))
+            return 0;
+        char *new_name = strdup(name);
+        if (!new_name)
+            return -1;
+        free(entry->name);
+        entry->name = new_name;
+        entry->parent_inode_n = parent_inode_n;
+        return 0;
+    }
+
+    if (table->count >= table->buckets_count)
+    {
+        if (index_table_grow(table) < 0)
+            return -1;
+    }
+
+    entry = malloc(sizeof(IndexEntry));
+    if (!entry)
+        return -1;
+    entry->name = strdup(name);
+    if (!entry->name)
+    {
+        free(entry);
+        return -1;
+    }
+    entry->inode_n = inode_n;
+    entry->parent_inode_n = parent_inode_n;
+
+    size_t bucket = index_bucket(table->buckets_count, inode_n);
+    entry->next = table->buckets[bucket];
+    table->buckets[bucket] = entry;
+    table->count++;
+    return 0;
+}
+
+static void index_table_remove(IndexTable *table, ino_t inode_n)
+{
+    IndexEntry **it = &table->buckets[index_bucket(table->buckets_count, inode_n)];
+    while (*it)
+    {
+        if ((*it)->inode_n == inode_n)
+        {
+            IndexEntry *entry = *it;
+            *it = entry->next;
+            index_free_entry(entry);
+            table->count--;
+            return;
+        }
+        it = &(*it)->next;
+    }
+}
+
+static void index_table_remove_entry(IndexTable *table, ino_t inode_n, ino_t parent_inode_n, const char *name)
+{
+    IndexEntry *entry = index_table_get(table, inode_n);
+    // other hard links may still exist, they are picked up again by the next rebuild
+    if (entry && (entry->parent_inode_n == parent_inode_n) && !strcmp(entry->name, name))
+        index_table_remove(table, inode_n);
+}
+
+int index_init(Index *index)
+{
+    if (index_table_init(&index->table, INDEX_INITIAL_BUCKETS_COUNT) < 0)
+        return -1;
+    index->generation = 0;
+    index->built_ms = 0;
+    index->building = 0;
+    index->changes = 0;
+    index->changes_count = 0;
+    index->changes_capacity = 0;
+    index->changes_lost = 0;
+    memset(index->misses, 0, sizeof(index->misses));
+    if ((pthread_rwlock_init(&index->lock, 0) != 0) | (pthread_mutex_init(&index->build_lock, 0) != 0)
+        | (pthread_mutex_init(&index->misses_lock, 0) != 0))
+        return -1;
+    return 0;
+}
+
+void index_clean(Index *index)
+{
+    pthread_rwlock_wrlock(&index->lock);
+    index_table_clean(&index->table);
+    free(index->changes);
+    index->changes = 0;
+    index->changes_capacity = 0;
+    pthread_rwlock_unlock(&index->lock);
+}
+
+static IndexMiss * index_miss_slot(Index *index, ino_t inode_n)
+{
+    return &index->misses[index_bucket(INDEX_MISSES_COUNT, inode_n)];
+}
+
+// known to be missing since less than INDEX_MISS_TIMEOUT_MS
+int index_missing(Index *index, ino_t inode_n)
+{
+    pthread_mutex_lock(&index->misses_lock);
+    IndexMiss *miss = index_miss_slot(index, inode_n);
+    int res = (miss->inode_n == inode_n) && (index_now_ms() - miss->time_ms < INDEX_MISS_TIMEOUT_MS);
+    pthread_mutex_unlock(&index->misses_lock);
+    return res;
+}
+
+void index_add_missing(Index *index, ino_t inode_n)
+{
+    pthread_mutex_lock(&index->misses_lock);
+    IndexMiss *miss = index_miss_slot(index, inode_n);
+    miss->inode_n = inode_n;
+    miss->time_ms = index_now_ms();
+    pthread_mutex_unlock(&index->misses_lock);
+}
+
+static void index_forget_missing(Index *index, ino_t inode_n)
+{
+    pthread_mutex_lock(&index->misses_lock);
+    IndexMiss *miss = index_miss_slot(index, inode_n);
+    if (miss->inode_n == inode_n)
+        miss->inode_n = 0;
+    pthread_mutex_unlock(&index->misses_lock);
+}
+
+// called under the write lock, remembers the change when a rebuild is walking the export
+static void index_record_change(Index *index, IndexChangeType type, ino_t inode_n, ino_t parent_inode_n, const char *name)
+{
+    if ((!index->building) | index->changes_lost)
+        return;
+
+    if (index->changes_count == index->changes_capacity)
+    {
+        size_t capacity = index->changes_capacity ? index->changes_capacity * 2 : 64;
+        IndexChange *changes = realloc(index->changes, capacity * sizeof(IndexChange));
+        if (!changes)
+        {
+            index->changes_lost = 1;
+            return;
+        }
+        index->changes = changes;
+        index->changes_capacity = capacity;
+    }
+
+    char *copy = name ? strdup(name) : 0;
+    if (name && !copy)
+    {
+        index->changes_lost = 1;
+        return;
+    }
+    index->changes[index->changes_count++] = (IndexChange) { .type = type, .inode_n = inode_n, .parent_inode_n = parent_inode_n, .name = copy };
+}
+
+int index_put(Index *index, ino_t inode_n, ino_t parent_inode_n, const char *name)
+{
+    // the inode number may have been reused by a new object
+    index_forget_missing(index, inode_n);
+    pthread_rwlock_wrlock(&index->lock);
+    int res = index_table_put(&index->table, inode_n, parent_inode_n, name);
+    if (res == 0)
+        index_record_change(index, INDEX_CHANGE_PUT, inode_n, parent_inode_n, name);
+    pthread_rwlock_unlock(&index->lock);
+    return res;
+}
+
+int index_contains(Index *index, ino_t inode_n)
+{
+    pthread_rwlock_rdlock(&index->lock);
+    int res = index_table_get(&index->table, inode_n) != 0;
+    pthread_rwlock_unlock(&index->lock);
+    return res;
+}
+
+int index_get_parent(Index *index, ino_t inode_n, ino_t *parent_inode_n, char **name)
+{
+    int res = -1;
+    pthread_rwlock_rdlock(&index->lock);
+    IndexEntry *entry = index_table_get(&index->table, inode_n);
+    if (entry)
+    {
+        *name = strdup(entry->name);
+        *parent_inode_n = entry->parent_inode_n;
+        if (*name)
+            res = 0;
+    }
+    pthread_rwlock_unlock(&index->lock);
+    return res;
+}
+
+void index_remove(Index *index, ino_t inode_n)
+{
+    pthread_rwlock_wrlock(&index->lock);
+    index_table_remove(&index->table, inode_n);
+    index_record_change(index, INDEX_CHANGE_REMOVE, inode_n, 0, 0);
+    pthread_rwlock_unlock(&index->lock);
+}
+
+void index_remove_entry(Index *index, ino_t inode_n, ino_t parent_inode_n, const char *name)
+{
+    pthread_rwlock_wrlock(&index->lock);
+    index_table_remove_entry(&index->table, inode_n, parent_inode_n, name);
+    index_record_change(index, INDEX_CHANGE_REMOVE_ENTRY, inode_n, parent_inode_n, name);
+    pthread_rwlock_unlock(&index->lock);
+}
+
+static int index_build_impl(IndexTable *table, int fd, ino_t inode_n, uint32_t depth)
+{
+    if (depth > INDEX_MAX_DEPTH)
+    {
+        close(fd);
+        return 0;
+    }
+
+    DIR *dir = fdopendir(fd);
+    if (!dir)
+    {
+        LOG_ERROR("index: cant open dir");
+        close(fd);
+        return -1;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)))
+    {
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+
+        if (index_table_put(table, ent->d_ino, inode_n, ent->d_name) < 0)
+        {
+            closedir(dir);
+            return -1;
+        }
+
+        unsigned char type = ent->d_type;
+        if (type == DT_UNKNOWN)
+        {
+            struct stat st;
+            if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+        }
+
+        if (type == DT_DIR)
+        {
+            int child_fd = openat(dirfd(dir), ent->d_name, O_RDONLY | O_DIRECTORY);
+            if (child_fd < 0)
+                continue;
+            if (index_build_impl(table, child_fd, ent->d_ino, depth + 1) < 0)
+            {
+                closedir(dir);
+                return -1;
+            }
+        }
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+// applies the changes made during the walk on top of its result, in the order they were made
+static int index_replay_changes(Index *index, IndexTable *table)
+{
+    int res = index->changes_lost ? -1 : 0;
+    for (size_t i = 0; i < index->changes_count; i++)
+    {
+        IndexChange *change = &index->changes[i];
+        if ((res == 0) & (change->type == INDEX_CHANGE_PUT))
+            res = index_table_put(table, change->inode_n, change->parent_inode_n, change->name);
+        else if ((res == 0) & (change->type == INDEX_CHANGE_REMOVE))
+            index_table_remove(table, change->inode_n);
+        else if ((res == 0) & (change->type == INDEX_CHANGE_REMOVE_ENTRY))
+            index_table_remove_entry(table, change->inode_n, change->parent_inode_n, change->name);
+        free(change->name);
+    }
+    index->changes_count = 0;
+    index->changes_lost = 0;
+    return res;
+}
+
+unsigned long index_generation(Index *index)
+{
+    pthread_rwlock_rdlock(&index->lock);
+    unsigned long generation = index->generation;
+    pthread_rwlock_unlock(&index->lock);
+    return generation;
+}
+
+// rebuilds the index unless somebody already did it since generation was read, or the last
+// rebuild was less than INDEX_REBUILD_INTERVAL_MS ago. Returns 1 when it walked the export.
+// The walk fills a new table while lookups keep using the old one, the lock is only taken
+// to swap them
+int index_build(Index *index, int root_fd, ino_t root_inode_n, unsigned long generation)
+{
+    int res = 0;
+    pthread_mutex_lock(&index->build_lock);
+    pthread_rwlock_wrlock(&index->lock);
+    int skip = (index->generation != generation)
+        || ((index->generation > 0) && (index_now_ms() - index->built_ms < INDEX_REBUILD_INTERVAL_MS));
+    size_t buckets_count = index->table.buckets_count;
+    index->building = !skip;
+    pthread_rwlock_unlock(&index->lock);
+    if (skip)
+        goto out;
+
+    IndexTable table;
+    res = -1;
+    if (index_table_init(&table, buckets_count) == 0)
+    {
+        int fd = openat(root_fd, ".", O_RDONLY | O_DIRECTORY);
+        if ((fd >= 0) && (index_build_impl(&table, fd, root_inode_n, 0) == 0))
+            res = 1;
+    }
+
+    pthread_rwlock_wrlock(&index->lock);
+    index->building = 0;
+    if ((index_replay_changes(index, &table) < 0) && (res == 1))
+        res = -1;
+    if (res == 1)
+    {
+        // the old table is freed below, outside the lock
+        IndexTable old = index->table;
+        index->table = table;
+        table = old;
+        index->generation++;
+        index->built_ms = index_now_ms();
+    }
+    size_t count = index->table.count;
+    pthread_rwlock_unlock(&index->lock);
+
+    if (table.buckets)
+    {
+        index_table_clean(&table);
+        free(table.buckets);
+    }
+    if (res < 0)
+        goto out;
+    LOG_INFO("index: %lu objects", count);
+
+    // whatever was missing may have been found by the walk
+    pthread_mutex_lock(&index->misses_lock);
+    memset(index->misses, 0, sizeof(index->misses));
+    pthread_mutex_unlock(&index->misses_lock);
+
+    out:
+    pthread_mutex_unlock(&index->build_lock);
+    return res;
+}
+
+int index_build_path(Index *index, ino_t root_inode_n, ino_t inode_n, char *path, size_t size)
+{
+    const char *names[INDEX_MAX_DEPTH];
+    uint32_t depth = 0;
+    int res = -1;
+
+    pthread_rwlock_rdlock(&index->lock);
+    while (inode_n != root_inode_n)
+    {
+        if (depth >= INDEX_MAX_DEPTH)
+            goto out;
+        IndexEntry *entry = index_table_get(&index->table, inode_n);
+        if (!entry)
+            goto out;
+        names[depth++] = entry->name;
+        inode_n = entry->parent_inode_n;
+    }
+
+    size_t off = 0;
+    if (depth == 0)
+    {
+        if (size < 2)
+            goto out;
+        path[off++] = '.';
+    }
+    while (depth > 0)
+    {
+        const char *name = names[--depth];
+        size_t len = strlen(name);
+        if (off + len + 2 > size)
+            goto out;
+        memcpy(path + off, name, len);
+        off += len;
+        if (depth > 0)
+            path[off++] = '/';
+    }
+    path[off] = 0;
+    res = 0;
+
+    out:
+    pthread_rwlock_unlock(&index->lock);
+    return res;
+}
\ No newline at end of file
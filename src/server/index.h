@@ -0,0 +1,85 @@
+#ifndef _INDEX_H
+#define _INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define INDEX_INITIAL_BUCKETS_COUNT 1024
+#define INDEX_MAX_DEPTH 512
+// a miss walks the export at most once per interval, the inode is then remembered as
+// missing for a while so that clients with stale inode numbers fail fast
+#define INDEX_REBUILD_INTERVAL_MS 1000
+#define INDEX_MISS_TIMEOUT_MS 10000
+#define INDEX_MISSES_COUNT 1024
+
+typedef struct IndexEntry
+{
+    ino_t inode_n;
+    ino_t parent_inode_n;
+    char *name;
+    struct IndexEntry *next;
+} IndexEntry;
+
+typedef struct IndexTable
+{
+    IndexEntry **buckets;
+    size_t buckets_count;
+    size_t count;
+} IndexTable;
+
+typedef enum IndexChangeType
+{
+    INDEX_CHANGE_PUT = 0,
+    INDEX_CHANGE_REMOVE,
+    INDEX_CHANGE_REMOVE_ENTRY,
+} IndexChangeType;
+
+// made while a rebuild walks the export, replayed on top of what the walk found
+typedef struct IndexChange
+{
+    IndexChangeType type;
+    ino_t inode_n;
+    ino_t parent_inode_n;
+    char *name;
+} IndexChange;
+
+typedef struct IndexMiss
+{
+    ino_t inode_n;
+    uint64_t time_ms;
+} IndexMiss;
+
+typedef struct Index
+{
+    IndexTable table;
+    unsigned long generation;
+    uint64_t built_ms;
+    pthread_rwlock_t lock;
+    // one rebuild at a time, the walk runs without lock and swaps its table in at the end
+    pthread_mutex_t build_lock;
+    int building;
+    IndexChange *changes;
+    size_t changes_count;
+    size_t changes_capacity;
+    int changes_lost;
+    // direct mapped by inode number, a colliding miss replaces the older one
+    IndexMiss misses[INDEX_MISSES_COUNT];
+    pthread_mutex_t misses_lock;
+} Index;
+
+int index_init(Index *index);
+void index_clean(Index *index);
+unsigned long index_generation(Index *index);
+int index_build(Index *index, int root_fd, ino_t root_inode_n, unsigned long generation);
+int index_put(Index *index, ino_t inode_n, ino_t parent_inode_n, const char *name);
+int index_contains(Index *index, ino_t inode_n);
+int index_get_parent(Index *index, ino_t inode_n, ino_t *parent_inode_n, char **name);
+void index_remove(Index *index, ino_t inode_n);
+void index_remove_entry(Index *index, ino_t inode_n, ino_t parent_inode_n, const char *name);
+int index_missing(Index *index, ino_t inode_n);
+void index_add_missing(Index *index, ino_t inode_n);
+int index_build_path(Index *index, ino_t root_inode_n, ino_t inode_n, char *path, size_t size);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// the drain thread writes this much at once
+#define LOG_OUTPUT_SIZE (64 * 1024)
+
+atomic_int log_level = LOG_DEFAULT_LEVEL;
+
+static const char *level_names[] = {
+    [LOG_LEVEL_ERROR] = "error",
+    [LOG_LEVEL_WARN] = "warn",
+    [LOG_LEVEL_INFO] = "info",
+    [LOG_LEVEL_DEBUG] = "debug",
+};
+
+// rings are never freed, a thread that exits leaves its ring to be drained
+static _Atomic(LogRing *) rings;
+static atomic_uint threads_count;
+static __thread LogRing *thread_ring;
+
+// serializes the drain thread with log_flush at exit, producers never take it
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static char output[LOG_OUTPUT_SIZE];
+
+static LogRing * log_ring(void)
+{
+    if (thread_ring)
+        return thread_ring;
+
+    LogRing *ring = calloc(1, sizeof(LogRing));
+    if (!ring)
+        return 0;
+    ring->thread_n = atomic_fetch_add(&threads_count, 1);
+    ring->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &ring->next, ring));
+    thread_ring = ring;
+    return ring;
+}
+
+void log_write(int level, const char *format, ...)
+{
+    LogRing *ring = log_ring();
+    if (!ring)
+        return;
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOG_RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    LogRecord *record = &ring->records[head & (LOG_RING_SIZE - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    record->time_ns = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    record->level = level;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(record->message, LOG_RECORD_SIZE, format, args);
+    va_end(args);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static size_t log_output(size_t used, const char *line, size_t length)
+{
+    if (used + length > LOG_OUTPUT_SIZE)
+    {
+        write(STDOUT_FILENO, output, used);
+        used = 0;
+    }
+    memcpy(output + used, line, length);
+    return used + length;
+}
+
+static size_t log_drain_ring(LogRing *ring, size_t used)
+{
+    char line[LOG_RECORD_SIZE + 64];
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    for (; tail != head; tail++)
+    {
+        LogRecord *record = &ring->records[tail & (LOG_RING_SIZE - 1)];
+        time_t sec = record->time_ns / 1000000000ULL;
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        int length = snprintf(line, sizeof(line), "%02d:%02d:%02d.%06llu %-5s [%u] %s\n",
+                              tm.tm_hour, tm.tm_min, tm.tm_sec, (unsigned long long) (record->time_ns % 1000000000ULL) / 1000,
+                              level_names[record->level], ring->thread_n, record->message);
+        if (length >= (int) sizeof(line))
+        {
+            length = sizeof(line) - 1;
+            line[length - 1] = '\n';
+        }
+        used = log_output(used, line, length);
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+    uint64_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+    if (dropped)
+    {
+        int length = snprintf(line, sizeof(line), "log: thread %u dropped %llu records\n", ring->thread_n, (unsigned long long) dropped);
+        used = log_output(used, line, length);
+    }
+    return used;
+}
+
+// records of different threads are written ring by ring, not merged by time
+void log_flush(void)
+{
+    pthread_mutex_lock(&drain_lock);
+    size_t used = 0;
+    for (LogRing *ring = atomic_load(&rings); ring; ring = ring->next)
+        used = log_drain_ring(ring, used);
+    if (used)
+        write(STDOUT_FILENO, output, used);
+    pthread_mutex_unlock(&drain_lock);
+}
+
+static void * log_drain(void *arg)
+{
+    (void) arg;
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = LOG_DRAIN_INTERVAL_MS * 1000000L };
+    while (1)
+    {
+        nanosleep(&interval, 0);
+        log_flush();
+    }
+    return 0;
+}
+
+int log_parse_level(const char *name)
+{
+    for (int i = LOG_LEVEL_ERROR; i <= LOG_LEVEL_DEBUG; i++)
+    {
+        if (!strcmp(name, level_names[i]))
+            return i;
+    }
+    return -1;
+}
+
+int log_init(int level)
+{
+    atomic_store(&log_level, level);
+    pthread_t thread;
+    if (pthread_create(&thread, 0, log_drain, 0) != 0)
+        return -1;
+    pthread_detach(thread);
+    atexit(log_flush);
+    return 0;
+}
\ No newline at end of file
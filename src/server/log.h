@@ -0,0 +1,64 @@
+#ifndef _LOG_H
+#define _LOG_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+// calls above this level compile to nothing, build with -DLOG_COMPILE_LEVEL=LOG_LEVEL_INFO to drop debug logging
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO
+
+// records longer than this are truncated
+#define LOG_RECORD_SIZE 240
+// records per thread, a power of two
+#define LOG_RING_SIZE 1024
+#define LOG_DRAIN_INTERVAL_MS 10
+
+extern atomic_int log_level;
+
+// arguments aren't evaluated when the level is off
+#define LOG_AT(level, ...) \
+    do \
+    { \
+        if (((level) <= LOG_COMPILE_LEVEL) && ((level) <= atomic_load_explicit(&log_level, memory_order_relaxed))) \
+            log_write((level), __VA_ARGS__); \
+    } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+typedef struct LogRecord
+{
+    uint64_t time_ns;
+    int level;
+    char message[LOG_RECORD_SIZE];
+} LogRecord;
+
+// written only by its thread and read only by the drain thread
+typedef struct LogRing
+{
+    LogRecord records[LOG_RING_SIZE];
+    atomic_uint_fast64_t head;
+    atomic_uint_fast64_t tail;
+    // records lost because the ring was full
+    atomic_uint_fast64_t dropped;
+    uint32_t thread_n;
+    struct LogRing *next;
+} LogRing;
+
+int log_init(int level);
+int log_parse_level(const char *name);
+void log_write(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void log_flush(void);
+
+#endif
\ No newline at end of file
@@ -1,36 +1,110 @@
 #include "../shared/protocol.h"
 #define _GNU_SOURCE
 #include "fs.h"
+#include "server.h"
+#include "fdcache.h"
 
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <getopt.h>
 
-#define MAX_CONNECTIONS 1
+#define LISTEN_BACKLOG SOMAXCONN
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    FSOptions opts = { .backend = BACKEND_TYPE_POSIX, .use_handles = 0, .fd_cache_size = FD_CACHE_DEFAULT_SIZE };
+    long threads_count = sysconf(_SC_NPROCESSORS_ONLN);
+    char *stats_path = 0;
+    char *trace_path = 0;
+    int level = LOG_DEFAULT_LEVEL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "Hj:f:s:l:t:b:")) != -1)
     {
-        printf("usage: server {root-path} {port}\n");
+        switch (opt)
+        {
+            case 'H':
+                opts.use_handles = 1;
+                break;
+            case 'j':
+                threads_count = atol(optarg);
+                break;
+            case 'f':
+                opts.fd_cache_size = atol(optarg);
+                break;
+            case 's':
+                stats_path = optarg;
+                break;
+            case 'b':
+                if (!strcmp(optarg, "posix"))
+                    opts.backend = BACKEND_TYPE_POSIX;
+                else if (!strcmp(optarg, "memory"))
+                    opts.backend = BACKEND_TYPE_MEMORY;
+                else
+                    goto usage;
+                break;
+            case 't':
+                trace_path = optarg;
+                break;
+            case 'l':
+                level = log_parse_level(optarg);
+                if (level < 0)
+                    goto usage;
+                break;
+            default:
+                goto usage;
+        }
+    }
+
+    if ((argc - optind != 2) | (threads_count <= 0))
+    {
+        usage:
+        printf("usage: server [-b backend] [-H] [-j threads] [-f fds] [-s stats-socket] [-t trace-file] [-l level] {root-path} {port}\n");
+        printf("  -b  posix serves root-path, memory serves an empty tree kept in memory and ignores it (default: posix)\n");
+        printf("  -H  identify objects by kernel file handles (needs CAP_DAC_READ_SEARCH)\n");
+        printf("  -j  number of worker threads (default: number of cpus)\n");
+        printf("  -f  number of open files to keep cached (default: %d, capped by RLIMIT_NOFILE)\n", FD_CACHE_DEFAULT_SIZE);
+        printf("  -s  unix socket that dumps statistics, as JSON if the client sends \"json\"\n");
+        printf("  -t  record every request to a trace file that replay can play back\n");
+        printf("  -l  log level: error, warn, info or debug (default: info)\n");
+        return -1;
+    }
+
+    if (log_init(level) < 0)
+    {
+        printf("can't start logging\n");
         return -1;
     }
 
     FS fs;
-    if (fs_init(argv[1], &fs) < 0)
+    if (fs_init(argv[optind], &opts, &fs) < 0)
+    {
+        LOG_ERROR("can't init fs");
+        return -1;
+    }
+
+    if (stats_path && (stats_listen(&fs.stats, stats_path) < 0))
     {
-        printf("can't init fs\n");
+        LOG_ERROR("can't listen on stats socket %s", stats_path);
         return -1;
     }
 
-    uint16_t port = atoi(argv[2]);
+    Trace trace;
+    if (trace_path && (trace_open(&trace, trace_path) < 0))
+    {
+        LOG_ERROR("can't open trace file %s", trace_path);
+        return -1;
+    }
+
+    uint16_t port = atoi(argv[optind + 1]);
 
     int sockfd;
     sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0)
     {
-        printf("can't create socket\n");
+        LOG_ERROR("can't create socket");
         return -1;
     }
 
@@ -43,56 +117,23 @@ int main(int argc, char **argv)
 
     if (bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
     {
-        printf("can't bind socket\n");
+        LOG_ERROR("can't bind socket");
         return -1;
     }
 
-    if (listen(sockfd, MAX_CONNECTIONS) < 0)
+    if (listen(sockfd, LISTEN_BACKLOG) < 0)
     {
-        printf("socket can't listen\n");
+        LOG_ERROR("socket can't listen");
         return -1;
     }
 
-    printf("server starting...\n");
-    while (1)
+    Server server;
+    if (server_init(&server, &fs, trace_path ? &trace : 0, sockfd, threads_count) < 0)
     {
-        accept_new_conn:
-        int connfd = accept(sockfd, 0, 0);
-        if (connfd < 0)
-        {
-            printf("accpet error\n");
-            goto accept_new_conn;
-        }
-        printf("got connection\n");
-        MethodRequest req;
-        MethodResponse resp;
-        memset(&req, 0, sizeof(MethodRequest));
-        memset(&resp, 0, sizeof(MethodResponse));
-        uint32_t to_read = sizeof(MethodRequest);
-        while (to_read > 0)
-        {
-            int len = read(connfd, &req + (sizeof(MethodRequest) - to_read), to_read);
-            if (len < 0)
-            {
-                printf("reading err\n");
-                goto accept_new_conn;
-            }
-            to_read -= len;
-        }
-        printf("got request\n");
-        fs_handle(&fs, &req, &resp);
-        uint32_t to_write = sizeof(MethodResponse);
-        while (to_write > 0)
-        {
-            int len = write(connfd, &resp + (sizeof(MethodResponse) - to_write), to_write);
-            if (len < 0)
-            {
-                printf("writing err\n");
-                goto accept_new_conn;
-            }
-            to_write -= len;
-        }
-        printf("sent response\n");
-        close(connfd);
+        LOG_ERROR("can't init server");
+        return -1;
     }
+
+    LOG_INFO("server starting with %ld workers...", threads_count);
+    server_run(&server);
 }
\ No newline at end of file
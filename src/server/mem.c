@@ -0,0 +1,695 @@
+#include "mem.h"
+#include "log.h"
+#include "../shared/wire.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const BackendOps mem_ops;
+
+static void * mem_arena_alloc(MemArena *arena)
+{
+    pthread_mutex_lock(&arena->lock);
+    void *extent = arena->free_list;
+    if (extent)
+        arena->free_list = *(void **) extent;
+    else
+    {
+        if (arena->left == 0)
+        {
+            if (arena->slabs_count == arena->slabs_capacity)
+            {
+                uint32_t capacity = arena->slabs_capacity ? arena->slabs_capacity * 2 : 16;
+                void **slabs = realloc(arena->slabs, capacity * sizeof(void *));
+                if (!slabs)
+                {
+                    pthread_mutex_unlock(&arena->lock);
+                    return 0;
+                }
+                arena->slabs = slabs;
+                arena->slabs_capacity = capacity;
+            }
+            char *slab = malloc((size_t) MEM_EXTENT_SIZE * MEM_SLAB_EXTENTS);
+            if (!slab)
+            {
+                pthread_mutex_unlock(&arena->lock);
+                return 0;
+            }
+            arena->slabs[arena->slabs_count++] = slab;
+            arena->next = slab;
+            arena->left = MEM_SLAB_EXTENTS;
+        }
+        extent = arena->next;
+        arena->next += MEM_EXTENT_SIZE;
+        arena->left--;
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    memset(extent, 0, MEM_EXTENT_SIZE);
+    return extent;
+}
+
+static void mem_arena_free(MemArena *arena, void *extent)
+{
+    pthread_mutex_lock(&arena->lock);
+    *(void **) extent = arena->free_list;
+    arena->free_list = extent;
+    pthread_mutex_unlock(&arena->lock);
+}
+
+static uint32_t mem_name_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (; *name; name++)
+        hash = (hash ^ (uint8_t) *name) * 16777619u;
+    return hash;
+}
+
+static uint32_t mem_inode_bucket(uint32_t buckets_count, __u64 inode_n)
+{
+    return (uint32_t) ((inode_n * 0x9E3779B97F4A7C15ULL) >> 17) & (buckets_count - 1);
+}
+
+static void mem_touch(MemNode *node)
+{
+    clock_gettime(CLOCK_REALTIME, &node->mtime);
+}
+
+static void mem_fill_attrs(MemNode *node, ObjectAttrs *attrs)
+{
+    pthread_rwlock_rdlock(&node->lock);
+    attrs->size = node->size;
+    attrs->mtime_sec = node->mtime.tv_sec;
+    attrs->mtime_nsec = node->mtime.tv_nsec;
+    pthread_rwlock_unlock(&node->lock);
+    // links are guarded by the backend lock, which the callers hold
+    attrs->nlink = node->nlink;
+}
+
+static void mem_truncate_locked(MemBackend *mem, MemNode *node)
+{
+    for (uint32_t i = 0; i < node->extents_count; i++)
+    {
+        if (node->extents[i])
+            mem_arena_free(&mem->arena, node->extents[i]);
+    }
+    free(node->extents);
+    node->extents = 0;
+    node->extents_count = 0;
+    node->size = 0;
+}
+
+static void mem_free_node(MemBackend *mem, MemNode *node)
+{
+    mem_truncate_locked(mem, node);
+    for (uint32_t i = 0; i < node->slots_count; i++)
+        free(node->slots[i]);
+    free(node->slots);
+    free(node->buckets);
+    pthread_rwlock_destroy(&node->lock);
+    free(node);
+}
+
+static void mem_put_node(MemBackend *mem, MemNode *node)
+{
+    if (atomic_fetch_sub(&node->refs, 1) == 1)
+        mem_free_node(mem, node);
+}
+
+// needs the backend lock, for writing
+static MemNode * mem_new_node(MemBackend *mem, uint32_t type)
+{
+    if (mem->inodes_count >= mem->inodes_buckets_count)
+    {
+        uint32_t buckets_count = mem->inodes_buckets_count * 2;
+        MemNode **buckets = calloc(buckets_count, sizeof(MemNode *));
+        if (!buckets)
+            return 0;
+        for (uint32_t i = 0; i < mem->inodes_buckets_count; i++)
+        {
+            MemNode *node = mem->inodes[i];
+            while (node)
+            {
+                MemNode *next = node->next;
+                uint32_t bucket = mem_inode_bucket(buckets_count, node->inode_n);
+                node->next = buckets[bucket];
+                buckets[bucket] = node;
+                node = next;
+            }
+        }
+        free(mem->inodes);
+        mem->inodes = buckets;
+        mem->inodes_buckets_count = buckets_count;
+    }
+
+    MemNode *node = calloc(1, sizeof(MemNode));
+    if (!node)
+        return 0;
+    if (type == OBJECT_TYPE_DIR)
+    {
+        node->buckets_count = MEM_DIR_INITIAL_BUCKETS;
+        node->buckets = calloc(node->buckets_count, sizeof(MemDirent *));
+        if (!node->buckets)
+        {
+            free(node);
+            return 0;
+        }
+    }
+    pthread_rwlock_init(&node->lock, 0);
+    node->inode_n = mem->next_inode_n++;
+    node->type = type;
+    node->nlink = 1;
+    atomic_init(&node->refs, 1);
+    mem_touch(node);
+
+    uint32_t bucket = mem_inode_bucket(mem->inodes_buckets_count, node->inode_n);
+    node->next = mem->inodes[bucket];
+    mem->inodes[bucket] = node;
+    mem->inodes_count++;
+    return node;
+}
+
+// needs the backend lock, for writing
+static void mem_forget_node(MemBackend *mem, MemNode *node)
+{
+    MemNode **it = &mem->inodes[mem_inode_bucket(mem->inodes_buckets_count, node->inode_n)];
+    while (*it != node)
+        it = &(*it)->next;
+    *it = node->next;
+    mem->inodes_count--;
+    mem_put_node(mem, node);
+}
+
+// needs the backend lock
+static MemNode * mem_find(MemBackend *mem, __u64 inode_n)
+{
+    uint64_t start = stats_now();
+    MemNode *node = mem->inodes[mem_inode_bucket(mem->inodes_buckets_count, inode_n)];
+    while (node && (node->inode_n != inode_n))
+        node = node->next;
+    stats_count_resolve(mem->base.stats, node ? STATS_RESOLVE_INDEX : STATS_RESOLVE_MISS);
+    stats_add_resolve(stats_now() - start);
+    return node;
+}
+
+static MemNode * mem_find_dir(MemBackend *mem, __u64 inode_n)
+{
+    MemNode *node = mem_find(mem, inode_n);
+    return node && (node->type == OBJECT_TYPE_DIR) ? node : 0;
+}
+
+static MemDirent ** mem_dir_slot(MemNode *dir, const char *name)
+{
+    MemDirent **it = &dir->buckets[mem_name_hash(name) & (dir->buckets_count - 1)];
+    while (*it && strcmp((*it)->name, name))
+        it = &(*it)->next;
+    return it;
+}
+
+static int mem_dir_add(MemNode *dir, const char *name, MemNode *node)
+{
+    if (dir->count >= dir->buckets_count * 2)
+    {
+        uint32_t buckets_count = dir->buckets_count * 4;
+        MemDirent **buckets = calloc(buckets_count, sizeof(MemDirent *));
+        if (buckets)
+        {
+            for (uint32_t i = 0; i < dir->buckets_count; i++)
+            {
+                MemDirent *entry = dir->buckets[i];
+                while (entry)
+                {
+                    MemDirent *next = entry->next;
+                    uint32_t bucket = mem_name_hash(entry->name) & (buckets_count - 1);
+                    entry->next = buckets[bucket];
+                    buckets[bucket] = entry;
+                    entry = next;
+                }
+            }
+            free(dir->buckets);
+            dir->buckets = buckets;
+            dir->buckets_count = buckets_count;
+        }
+    }
+    if (dir->slots_count == dir->slots_capacity)
+    {
+        uint32_t capacity = dir->slots_capacity ? dir->slots_capacity * 2 : 16;
+        MemDirent **slots = realloc(dir->slots, capacity * sizeof(MemDirent *));
+        if (!slots)
+            return -1;
+        dir->slots = slots;
+        dir->slots_capacity = capacity;
+    }
+
+    size_t length = strlen(name);
+    MemDirent *entry = malloc(sizeof(MemDirent) + length + 1);
+    if (!entry)
+        return -1;
+    entry->node = node;
+    memcpy(entry->name, name, length + 1);
+    dir->slots[dir->slots_count++] = entry;
+    entry->cookie = ++dir->last_cookie;
+
+    uint32_t bucket = mem_name_hash(name) & (dir->buckets_count - 1);
+    entry->next = dir->buckets[bucket];
+    dir->buckets[bucket] = entry;
+    dir->count++;
+    mem_touch(dir);
+    return 0;
+}
+
+// the entry keeps its slot so that the cookies of the following entries keep their order,
+// the slots are compacted once the removed entries outnumber the live ones
+static void mem_dir_remove(MemNode *dir, MemDirent **it)
+{
+    MemDirent *entry = *it;
+    *it = entry->next;
+    entry->node = 0;
+    entry->next = 0;
+    dir->count--;
+    mem_touch(dir);
+
+    if ((dir->slots_count < MEM_DIR_INITIAL_BUCKETS) | (dir->slots_count - dir->count <= dir->count))
+        return;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < dir->slots_count; i++)
+    {
+        if (dir->slots[i]->node)
+            dir->slots[count++] = dir->slots[i];
+        else
+            free(dir->slots[i]);
+    }
+    dir->slots_count = count;
+}
+
+// the first slot whose entry comes after the cookie
+static uint32_t mem_dir_resume(MemNode *dir, uint64_t cookie)
+{
+    uint32_t low = 0, high = dir->slots_count;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (dir->slots[middle]->cookie <= cookie)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static int mem_create(Backend *backend, CreateRequest *req, CreateResponse *resp)
+{
+    MemBackend *mem = (MemBackend *) backend;
+    LOG_DEBUG("create: %s", req->name);
+    if ((!req->name[0]) | ((req->type != OBJECT_TYPE_FILE) & (req->type != OBJECT_TYPE_DIR)))
+        return -1;
+
+    int res = -1;
+    pthread_rwlock_wrlock(&mem->lock);
+    MemNode *parent = mem_find_dir(mem, req->parent_inode_n);
+    if (!parent)
+        goto out;
+
+    MemDirent *entry = *mem_dir_slot(parent, req->name);
+    MemNode *node;
+    if (entry)
+    {
+        // like O_CREAT | O_TRUNC, an existing file is emptied and reused
+        node = entry->node;
+        if ((node->type != OBJECT_TYPE_FILE) | (req->type != OBJECT_TYPE_FILE))
+            goto out;
+        pthread_rwlock_wrlock(&node->lock);
+        mem_truncate_locked(mem, node);
+        mem_touch(node);
+        pthread_rwlock_unlock(&node->lock);
+    }
+    else
+    {
+        node = mem_new_node(mem, req->type);
+        if (!node)
+            goto out;
+        if (mem_dir_add(parent, req->name, node) < 0)
+        {
+            mem_forget_node(mem, node);
+            goto out;
+        }
+    }
+    resp->inode_n = node->inode_n;
+    resp->handle.length = 0;
+    res = 0;
+
+    out:
+    pthread_rwlock_unlock(&mem->lock);
+    return res;
+}
+
+static int mem_link(Backend *backend, LinkRequest *req, LinkResponse *resp)
+{
+    (void) resp;
+    MemBackend *mem = (MemBackend *) backend;
+    LOG_DEBUG("link: %s", req->name);
+    if (!req->name[0])
+        return -1;
+
+    int res = -1;
+    pthread_rwlock_wrlock(&mem->lock);
+    MemNode *source = mem_find(mem, req->source_inode_n);
+    MemNode *parent = mem_find_dir(mem, req->parent_inode_n);
+    if (source && parent && (source->type == OBJECT_TYPE_FILE) && !*mem_dir_slot(parent, req->name)
+        && (mem_dir_add(parent, req->name, source) == 0))
+    {
+        source->nlink++;
+        res = 0;
+    }
+    pthread_rwlock_unlock(&mem->lock);
+    return res;
+}
+
+static int mem_unlink(Backend *backend, UnlinkRequest *req, UnlinkResponse *resp)
+{
+    MemBackend *mem = (MemBackend *) backend;
+    LOG_DEBUG("unlink: %s", req->name);
+
+    int res = -1;
+    pthread_rwlock_wrlock(&mem->lock);
+    MemNode *parent = mem_find_dir(mem, req->parent_inode_n);
+    MemDirent **it = parent ? mem_dir_slot(parent, req->name) : 0;
+    if (it && *it && ((*it)->node->type == OBJECT_TYPE_FILE))
+    {
+        MemNode *node = (*it)->node;
+        mem_dir_remove(parent, it);
+        resp->nlink = --node->nlink;
+        if (node->nlink == 0)
+            mem_forget_node(mem, node);
+        res = 0;
+    }
+    pthread_rwlock_unlock(&mem->lock);
+    return res;
+}
+
+static int mem_rmdir(Backend *backend, RmdirRequest *req, RmdirResponse *resp)
+{
+    (void) resp;
+    MemBackend *mem = (MemBackend *) backend;
+    LOG_DEBUG("rmdir: %s", req->name);
+
+    int res = -1;
+    pthread_rwlock_wrlock(&mem->lock);
+    MemNode *parent = mem_find_dir(mem, req->parent_inode_n);
+    MemDirent **it = parent ? mem_dir_slot(parent, req->name) : 0;
+    if (it && *it && ((*it)->node->type == OBJECT_TYPE_DIR) && ((*it)->node->count == 0))
+    {
+        MemNode *node = (*it)->node;
+        mem_dir_remove(parent, it);
+        node->nlink = 0;
+        mem_forget_node(mem, node);
+        res = 0;
+    }
+    pthread_rwlock_unlock(&mem->lock);
+    return res;
+}
+
+static int mem_lookup(Backend *backend, LookupRequest *req, LookupResponse *resp)
+{
+    MemBackend *mem = (MemBackend *) backend;
+    LOG_DEBUG("lookup: %s", req->name);
+
+    int res = -1;
+    pthread_rwlock_rdlock(&mem->lock);
+    MemNode *parent = mem_find_dir(mem, req->parent_inode_n);
+    MemDirent *entry = parent ? *mem_dir_slot(parent, req->name) : 0;
+    if (entry)
+    {
+        resp->info = (ObjectInfo) { .inode_n = entry->node->inode_n, .type = entry->node->type };
+        mem_fill_attrs(entry->node, &resp->attrs);
+        res = 0;
+    }
+    pthread_rwlock_unlock(&mem->lock);
+    return res;
+}
+
+static int mem_list(Backend *backend, ListRequest *req, ListResponse *resp)
+{
+    MemBackend *mem = (MemBackend *) backend;
+    LOG_DEBUG("list: cookie: %llu, plus: %u", req->cookie, req->plus);
+
+    // eof, plus and count come before the entries
+    uint32_t budget = ((req->max_bytes == 0) | (req->max_bytes > WIRE_MAX_BODY_SIZE)) ? WIRE_MAX_BODY_SIZE : req->max_bytes;
+    uint32_t used = 6;
+
+    pthread_rwlock_rdlock(&mem->lock);
+    MemNode *dir = mem_find_dir(mem, req->inode_n);
+    if (!dir)
+    {
+        pthread_rwlock_unlock(&mem->lock);
+        return -1;
+    }
+
+    resp->eof = 0;
+    resp->plus = req->plus != 0;
+    resp->objects.count = 0;
+    uint32_t slot = mem_dir_resume(dir, req->cookie);
+    while (resp->objects.count < MAX_OBJECTS_COUNT)
+    {
+        if (slot >= dir->slots_count)
+        {
+            resp->eof = 1;
+            break;
+        }
+        MemDirent *entry = dir->slots[slot++];
+        if (!entry->node)
+            continue;
+
+        Object *obj = &resp->objects.objects[resp->objects.count];
+        memset(obj, 0, sizeof(Object));
+        obj->info = (ObjectInfo) { .inode_n = entry->node->inode_n, .type = entry->node->type };
+        obj->cookie = entry->cookie;
+        strcpy(obj->name, entry->name);
+        if (resp->plus)
+            mem_fill_attrs(entry->node, &obj->attrs);
+
+        // the entry is sent again by the next call, which resumes at the previous cookie
+        uint32_t size = wire_object_size(obj, resp->plus);
+        if (used + size > budget)
+            break;
+        used += size;
+        resp->objects.count++;
+    }
+    pthread_rwlock_unlock(&mem->lock);
+
+    LOG_DEBUG("list: %d objects, eof: %u", resp->objects.count, resp->eof);
+    if ((resp->objects.count == 0) & !resp->eof)
+    {
+        LOG_ERROR("list: max_bytes %u can't fit an entry", req->max_bytes);
+        return -1;
+    }
+    return 0;
+}
+
+// the node stays alive until mem_put_node even if it is unlinked meanwhile
+static MemNode * mem_get_file(MemBackend *mem, __u64 inode_n)
+{
+    pthread_rwlock_rdlock(&mem->lock);
+    MemNode *node = mem_find(mem, inode_n);
+    if (node && (node->type == OBJECT_TYPE_FILE))
+        atomic_fetch_add(&node->refs, 1);
+    else
+        node = 0;
+    pthread_rwlock_unlock(&mem->lock);
+    return node;
+}
+
+// copies the data out, it is sent from the range buffer and freed by mem_release
+static int mem_read(Backend *backend, ReadRequest *req, ReadResponse *resp, FSData *data)
+{
+    MemBackend *mem = (MemBackend *) backend;
+    LOG_DEBUG("read");
+    MemNode *node = mem_get_file(mem, req->inode_n);
+    if (!node)
+        return -1;
+
+    pthread_rwlock_rdlock(&node->lock);
+    uint32_t length = req->length > MAX_DATA_LENGTH ? MAX_DATA_LENGTH : req->length;
+    if (req->offset >= node->size)
+        length = 0;
+    else if (node->size - req->offset < length)
+        length = node->size - req->offset;
+
+    char *buf = malloc(length + 1);
+    if (!buf)
+    {
+        pthread_rwlock_unlock(&node->lock);
+        mem_put_node(mem, node);
+        return -1;
+    }
+    uint32_t done = 0;
+    while (done < length)
+    {
+        uint64_t offset = req->offset + done;
+        uint64_t extent_n = offset / MEM_EXTENT_SIZE;
+        uint32_t in_extent = offset % MEM_EXTENT_SIZE;
+        uint32_t chunk = MEM_EXTENT_SIZE - in_extent < length - done ? MEM_EXTENT_SIZE - in_extent : length - done;
+        if ((extent_n < node->extents_count) && node->extents[extent_n])
+            memcpy(buf + done, node->extents[extent_n] + in_extent, chunk);
+        else
+            memset(buf + done, 0, chunk);
+        done += chunk;
+    }
+    pthread_rwlock_unlock(&node->lock);
+    mem_put_node(mem, node);
+
+    resp->length = length;
+    data->ranges[data->ranges_count++] = (FSRange) { .fd = -1, .offset = req->offset, .length = length, .buf = buf };
+    LOG_DEBUG("read: %u bytes at %llu", resp->length, req->offset);
+    return 0;
+}
+
+static int mem_write(Backend *backend, WriteRequest *req, WriteResponse *resp, FSData *data)
+{
+    MemBackend *mem = (MemBackend *) backend;
+    LOG_DEBUG("write: len: %u, off: %llu, ino: %llu", req->length, req->offset, req->inode_n);
+    if ((req->offset > MEM_MAX_FILE_SIZE) || (req->length > MEM_MAX_FILE_SIZE - req->offset))
+        return -1;
+    MemNode *node = mem_get_file(mem, req->inode_n);
+    if (!node)
+        return -1;
+
+    int res = 0;
+    pthread_rwlock_wrlock(&node->lock);
+    uint64_t end = req->offset + req->length;
+    uint64_t extents_count = (end + MEM_EXTENT_SIZE - 1) / MEM_EXTENT_SIZE;
+    if (extents_count > node->extents_count)
+    {
+        char **extents = realloc(node->extents, extents_count * sizeof(char *));
+        if (extents)
+        {
+            memset(extents + node->extents_count, 0, (extents_count - node->extents_count) * sizeof(char *));
+            node->extents = extents;
+            node->extents_count = extents_count;
+        }
+        else
+            res = -1;
+    }
+
+    uint32_t done = 0;
+    while ((res == 0) & (done < req->length))
+    {
+        uint64_t offset = req->offset + done;
+        uint64_t extent_n = offset / MEM_EXTENT_SIZE;
+        uint32_t in_extent = offset % MEM_EXTENT_SIZE;
+        uint32_t chunk = MEM_EXTENT_SIZE - in_extent < req->length - done ? MEM_EXTENT_SIZE - in_extent : req->length - done;
+        if (!node->extents[extent_n])
+            node->extents[extent_n] = mem_arena_alloc(&mem->arena);
+        if (!node->extents[extent_n])
+        {
+            res = -1;
+            break;
+        }
+        memcpy(node->extents[extent_n] + in_extent, data->buf + done, chunk);
+        done += chunk;
+    }
+    if (req->offset + done > node->size)
+        node->size = req->offset + done;
+    mem_touch(node);
+    resp->attrs = (ObjectAttrs) { .size = node->size, .mtime_sec = node->mtime.tv_sec, .mtime_nsec = node->mtime.tv_nsec };
+    pthread_rwlock_unlock(&node->lock);
+    // links are guarded by the backend lock, which is taken before the node's
+    pthread_rwlock_rdlock(&mem->lock);
+    resp->attrs.nlink = node->nlink;
+    pthread_rwlock_unlock(&mem->lock);
+    mem_put_node(mem, node);
+
+    if (res < 0)
+        return -1;
+    resp->length = done;
+    data->buf += done;
+    return 0;
+}
+
+static int mem_mount(Backend *backend, MountRequest *req, MountResponse *resp)
+{
+    (void) req;
+    MemBackend *mem = (MemBackend *) backend;
+    resp->inode_n = mem->root->inode_n;
+    resp->handle.length = 0;
+    return 0;
+}
+
+static int mem_getattr(Backend *backend, GetattrRequest *req, GetattrResponse *resp)
+{
+    MemBackend *mem = (MemBackend *) backend;
+    LOG_DEBUG("getattr: %llu", req->inode_n);
+    pthread_rwlock_rdlock(&mem->lock);
+    MemNode *node = mem_find(mem, req->inode_n);
+    if (node)
+        mem_fill_attrs(node, &resp->attrs);
+    pthread_rwlock_unlock(&mem->lock);
+    return node ? 0 : -1;
+}
+
+static void mem_release(Backend *backend, FSRange *range)
+{
+    (void) backend;
+    free(range->buf);
+}
+
+static void mem_clean(Backend *backend)
+{
+    MemBackend *mem = (MemBackend *) backend;
+    pthread_rwlock_wrlock(&mem->lock);
+    for (uint32_t i = 0; i < mem->inodes_buckets_count; i++)
+    {
+        MemNode *node = mem->inodes[i];
+        while (node)
+        {
+            MemNode *next = node->next;
+            mem_free_node(mem, node);
+            node = next;
+        }
+    }
+    free(mem->inodes);
+    mem->inodes = 0;
+    for (uint32_t i = 0; i < mem->arena.slabs_count; i++)
+        free(mem->arena.slabs[i]);
+    free(mem->arena.slabs);
+    pthread_rwlock_unlock(&mem->lock);
+}
+
+int mem_init(MemBackend *mem, Stats *stats)
+{
+    memset(mem, 0, sizeof(MemBackend));
+    mem->base.ops = &mem_ops;
+    mem->base.stats = stats;
+    if ((pthread_rwlock_init(&mem->lock, 0) != 0) | (pthread_mutex_init(&mem->arena.lock, 0) != 0))
+        return -1;
+
+    mem->inodes_buckets_count = MEM_INODES_INITIAL_BUCKETS;
+    mem->inodes = calloc(mem->inodes_buckets_count, sizeof(MemNode *));
+    if (!mem->inodes)
+        return -1;
+
+    // the root gets the number clients use for it, so no other object can collide with it
+    mem->next_inode_n = ROOT_DIR_INODE_N;
+    mem->root = mem_new_node(mem, OBJECT_TYPE_DIR);
+    if (!mem->root)
+        return -1;
+    mem->base.root_inode_n = mem->root->inode_n;
+    LOG_INFO("memory: serving an empty tree, %u byte extents", MEM_EXTENT_SIZE);
+    return 0;
+}
+
+static const BackendOps mem_ops = {
+    .name = "memory",
+    .create = mem_create,
+    .link = mem_link,
+    .unlink = mem_unlink,
+    .read = mem_read,
+    .write = mem_write,
+    .list = mem_list,
+    .rmdir = mem_rmdir,
+    .lookup = mem_lookup,
+    .mount = mem_mount,
+    .getattr = mem_getattr,
+    .release = mem_release,
+    .clean = mem_clean,
+};
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef _MEM_H
+#define _MEM_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "backend.h"
+
+// file data lives in fixed size extents, holes have none
+#define MEM_EXTENT_SIZE (64 * 1024)
+// extents carved out of one arena allocation
+#define MEM_SLAB_EXTENTS 64
+#define MEM_MAX_FILE_SIZE (1ULL << 36)
+#define MEM_DIR_INITIAL_BUCKETS 16
+#define MEM_INODES_INITIAL_BUCKETS 1024
+
+typedef struct MemDirent
+{
+    struct MemNode *node;
+    // grows with every entry added to the directory, stable for the lifetime of the entry
+    uint64_t cookie;
+    struct MemDirent *next;
+    char name[];
+} MemDirent;
+
+typedef struct MemNode
+{
+    __u64 inode_n;
+    uint32_t type;
+    uint32_t nlink;
+    // one for being linked plus one per request using the node, the last put frees it
+    atomic_uint refs;
+    // size, mtime and extents of files, directories are guarded by the backend lock
+    pthread_rwlock_t lock;
+    uint64_t size;
+    struct timespec mtime;
+
+    // directories: entries hashed by name and in the order they were added
+    MemDirent **buckets;
+    uint32_t buckets_count;
+    uint32_t count;
+    // removed entries stay here with no node until they outnumber the live ones
+    MemDirent **slots;
+    uint32_t slots_count;
+    uint32_t slots_capacity;
+    uint64_t last_cookie;
+
+    // files
+    char **extents;
+    uint32_t extents_count;
+
+    struct MemNode *next;
+} MemNode;
+
+// hands out extents and takes them back, freed extents are reused before new slabs are allocated
+typedef struct MemArena
+{
+    pthread_mutex_t lock;
+    void *free_list;
+    void **slabs;
+    uint32_t slabs_count;
+    uint32_t slabs_capacity;
+    // extents of the current slab that were never handed out
+    char *next;
+    uint32_t left;
+} MemArena;
+
+typedef struct MemBackend
+{
+    Backend base;
+    // guards the tree: directories, link counts and the inode table
+    pthread_rwlock_t lock;
+    MemNode **inodes;
+    uint32_t inodes_buckets_count;
+    uint32_t inodes_count;
+    __u64 next_inode_n;
+    MemNode *root;
+    MemArena arena;
+} MemBackend;
+
+int mem_init(MemBackend *mem, Stats *stats);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "pool.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void * pool_worker(void *arg)
+{
+    Pool *pool = arg;
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->count == 0)
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+
+        PoolTask task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pthread_cond_signal(&pool->not_full);
+        pthread_mutex_unlock(&pool->lock);
+
+        task.job(task.arg);
+    }
+    return 0;
+}
+
+int pool_init(Pool *pool, uint32_t threads_count, uint32_t capacity)
+{
+    pool->threads_count = threads_count;
+    pool->capacity = capacity;
+    pool->head = 0;
+    pool->count = 0;
+
+    pool->tasks = calloc(capacity, sizeof(PoolTask));
+    pool->threads = calloc(threads_count, sizeof(pthread_t));
+    if (!pool->tasks | !pool->threads)
+        return -1;
+
+    if ((pthread_mutex_init(&pool->lock, 0) != 0) | (pthread_cond_init(&pool->not_empty, 0) != 0) | (pthread_cond_init(&pool->not_full, 0) != 0))
+        return -1;
+
+    for (uint32_t i = 0; i < threads_count; i++)
+    {
+        if (pthread_create(&pool->threads[i], 0, pool_worker, pool) != 0)
+        {
+            LOG_ERROR("pool: cant start worker %u", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// blocks while the queue is full, so a slow pool throttles the producer
+void pool_submit(Pool *pool, PoolJob job, void *arg)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == pool->capacity)
+        pthread_cond_wait(&pool->not_full, &pool->lock);
+
+    pool->tasks[(pool->head + pool->count) % pool->capacity] = (PoolTask) { .job = job, .arg = arg };
+    pool->count++;
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+}
\ No newline at end of file
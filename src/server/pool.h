@@ -0,0 +1,31 @@
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+typedef void (*PoolJob)(void *arg);
+
+typedef struct PoolTask
+{
+    PoolJob job;
+    void *arg;
+} PoolTask;
+
+typedef struct Pool
+{
+    pthread_t *threads;
+    uint32_t threads_count;
+    PoolTask *tasks;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} Pool;
+
+int pool_init(Pool *pool, uint32_t threads_count, uint32_t capacity);
+void pool_submit(Pool *pool, PoolJob job, void *arg);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,678 @@
+#include "posix.h"
+#include "log.h"
+#include "../shared/wire.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+extern int errno;
+
+static const BackendOps posix_ops;
+
+typedef union FileHandleBuf
+{
+    struct file_handle fh;
+    unsigned char bytes[sizeof(struct file_handle) + MAX_HANDLE_SIZE];
+} FileHandleBuf;
+
+int posix_init_handles(PosixBackend *posix)
+{
+    FileHandleBuf buf;
+    buf.fh.handle_bytes = MAX_HANDLE_SIZE;
+    int mount_id;
+    if (name_to_handle_at(posix->root, "", &buf.fh, &mount_id, AT_EMPTY_PATH) < 0)
+        return -1;
+
+    // open_by_handle_at needs CAP_DAC_READ_SEARCH, check it once here
+    int fd = open_by_handle_at(posix->root, &buf.fh, 0);
+    if (fd < 0)
+        return -1;
+    close(fd);
+
+    posix->root_mount_id = mount_id;
+    return 0;
+}
+
+int posix_init(PosixBackend *posix, char *path, FSOptions *opts, Stats *stats)
+{
+    LOG_INFO("posix: serving %s", path);
+    int fd = open(path, 0);
+    if (fd < 0)
+        return -1;
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return -1;
+
+    posix->base.ops = &posix_ops;
+    posix->base.root_inode_n = st.st_ino;
+    posix->base.stats = stats;
+    posix->root = fd;
+
+    if (index_init(&posix->index) < 0)
+        return -1;
+    if (index_build(&posix->index, posix->root, posix->base.root_inode_n, index_generation(&posix->index)) < 0)
+        return -1;
+
+    // cached fds must leave room below RLIMIT_NOFILE for connections and uncached opens
+    uint32_t fd_cache_size = opts->fd_cache_size;
+    struct rlimit limit;
+    if ((getrlimit(RLIMIT_NOFILE, &limit) == 0) & (limit.rlim_cur != RLIM_INFINITY))
+    {
+        rlim_t available = limit.rlim_cur > 2 * FD_CACHE_RESERVED_FDS ? limit.rlim_cur - FD_CACHE_RESERVED_FDS : limit.rlim_cur / 2;
+        if (fd_cache_size > available)
+            fd_cache_size = available;
+    }
+    if (fd_cache_size == 0)
+        fd_cache_size = 1;
+    LOG_INFO("posix: caching up to %u fds", fd_cache_size);
+    if (fd_cache_init(&posix->fds, fd_cache_size) < 0)
+        return -1;
+
+    posix->use_handles = 0;
+    if (opts->use_handles)
+    {
+        if (posix_init_handles(posix) < 0)
+            LOG_WARN("posix: cant use file handles (%s), falling back to inode index", strerror(errno));
+        else
+            posix->use_handles = 1;
+    }
+    return 0;
+}
+
+static void posix_clean(Backend *backend)
+{
+    PosixBackend *posix = (PosixBackend *) backend;
+    fd_cache_clean(&posix->fds);
+    index_clean(&posix->index);
+    free(posix->index.table.buckets);
+    long n = sysconf(_SC_OPEN_MAX);
+    for (long i = 5; i < n; i++)
+        close(i);
+}
+
+int posix_find_object_by_inode_n_impl(PosixBackend *posix, ino_t inode_n)
+{
+    char path[MAX_PATH_SIZE];
+    if (index_build_path(&posix->index, posix->base.root_inode_n, inode_n, path, MAX_PATH_SIZE) < 0)
+        return -1;
+
+    int fd = openat(posix->root, path, O_RDWR);
+    if (fd <= 0)
+    {
+        fd = openat(posix->root, path, 0);
+        if (fd <= 0)
+            return -1;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) < 0) | (st.st_ino != inode_n))
+    {
+        LOG_ERROR("find_by_inode stale index entry %s", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int posix_find_object_by_inode_n(PosixBackend *posix, ino_t inode_n)
+{
+    LOG_DEBUG("find: %lu, root: %d", inode_n, posix->root);
+    if (inode_n == posix->base.root_inode_n)
+        return posix->root;
+
+    unsigned long generation = index_generation(&posix->index);
+    int res = posix_find_object_by_inode_n_impl(posix, inode_n);
+    if (res < 0)
+    {
+        if (index_missing(&posix->index, inode_n))
+            return 0;
+        int built = index_build(&posix->index, posix->root, posix->base.root_inode_n, generation);
+        if (built < 0)
+            return -1;
+        if (built > 0)
+        {
+            LOG_WARN("find: %lu missed the index, rebuilt it", inode_n);
+            stats_count_resolve(posix->base.stats, STATS_RESOLVE_REBUILD);
+        }
+        res = posix_find_object_by_inode_n_impl(posix, inode_n);
+        if (res < 0)
+        {
+            index_add_missing(&posix->index, inode_n);
+            return 0;
+        }
+    }
+    LOG_DEBUG("find: found: %d", res);
+    return res;
+}
+
+int posix_find_parent_dir_and_name_by_inode_n(PosixBackend *posix, ino_t inode_n, char **name)
+{
+    LOG_DEBUG("find parent: %lu, root: %d", inode_n, posix->root);
+    ino_t parent_inode_n;
+    unsigned long generation = index_generation(&posix->index);
+    if (index_get_parent(&posix->index, inode_n, &parent_inode_n, name) < 0)
+    {
+        if (index_missing(&posix->index, inode_n))
+            return 0;
+        int built = index_build(&posix->index, posix->root, posix->base.root_inode_n, generation);
+        if (built < 0)
+            return -1;
+        if (built > 0)
+            stats_count_resolve(posix->base.stats, STATS_RESOLVE_REBUILD);
+        if (index_get_parent(&posix->index, inode_n, &parent_inode_n, name) < 0)
+        {
+            index_add_missing(&posix->index, inode_n);
+            return 0;
+        }
+    }
+
+    Handle no_handle = { .length = 0 };
+    int res = posix_find_object(posix, parent_inode_n, &no_handle);
+    LOG_DEBUG("find parent: %d, name: %s", res, *name);
+    return res;
+}
+
+void posix_get_handle(PosixBackend *posix, int dir_fd, const char *name, Handle *handle)
+{
+    handle->length = 0;
+    if (!posix->use_handles)
+        return;
+
+    FileHandleBuf buf;
+    buf.fh.handle_bytes = MAX_HANDLE_SIZE;
+    int mount_id;
+    if (name_to_handle_at(dir_fd, name, &buf.fh, &mount_id, name[0] ? 0 : AT_EMPTY_PATH) < 0)
+        return;
+    // objects on other mounts can't be reopened relative to the root fd
+    if (mount_id != posix->root_mount_id)
+        return;
+
+    handle->type = buf.fh.handle_type;
+    handle->length = buf.fh.handle_bytes;
+    memcpy(handle->bytes, buf.fh.f_handle, buf.fh.handle_bytes);
+}
+
+int posix_open_handle(PosixBackend *posix, Handle *handle, ino_t inode_n)
+{
+    if (handle->length > MAX_HANDLE_SIZE)
+        return -1;
+
+    FileHandleBuf buf;
+    buf.fh.handle_type = handle->type;
+    buf.fh.handle_bytes = handle->length;
+    memcpy(buf.fh.f_handle, handle->bytes, handle->length);
+
+    int fd = open_by_handle_at(posix->root, &buf.fh, O_RDWR);
+    if (fd <= 0)
+    {
+        fd = open_by_handle_at(posix->root, &buf.fh, 0);
+        if (fd <= 0)
+            return -1;
+    }
+
+    // handles come from the client, only accept ones that point into the export
+    struct stat st;
+    if ((fstat(fd, &st) < 0) | (st.st_ino != inode_n) | !index_contains(&posix->index, st.st_ino))
+    {
+        LOG_ERROR("open_handle rejected handle for %lu", inode_n);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int posix_find_object_impl(PosixBackend *posix, ino_t inode_n, Handle *handle, StatsResolvePath *path)
+{
+    *path = STATS_RESOLVE_ROOT;
+    if (inode_n == posix->base.root_inode_n)
+        return posix->root;
+
+    *path = STATS_RESOLVE_CACHE;
+    int fd = fd_cache_get(&posix->fds, inode_n);
+    if (fd >= 0)
+        return fd;
+
+    fd = -1;
+    *path = STATS_RESOLVE_HANDLE;
+    if (posix->use_handles & (handle->length > 0))
+    {
+        fd = posix_open_handle(posix, handle, inode_n);
+        if (fd <= 0)
+            LOG_WARN("find: bad handle for %lu, falling back to index", inode_n);
+    }
+    if (fd <= 0)
+    {
+        *path = STATS_RESOLVE_INDEX;
+        fd = posix_find_object_by_inode_n(posix, inode_n);
+    }
+    if (fd <= 0)
+        return fd;
+    return fd_cache_put(&posix->fds, inode_n, fd);
+}
+
+// the fd comes from the fd cache when possible, give it back with posix_release_fd
+int posix_find_object(PosixBackend *posix, ino_t inode_n, Handle *handle)
+{
+    uint64_t start = stats_now();
+    StatsResolvePath path;
+    int fd = posix_find_object_impl(posix, inode_n, handle, &path);
+    stats_count_resolve(posix->base.stats, fd > 0 ? path : STATS_RESOLVE_MISS);
+    stats_add_resolve(stats_now() - start);
+    return fd;
+}
+
+void posix_release_fd(PosixBackend *posix, int fd)
+{
+    if ((fd <= 0) | (fd == posix->root))
+        return;
+    if (!fd_cache_release(&posix->fds, fd))
+        close(fd);
+}
+
+static int posix_create(Backend *backend, CreateRequest *req, CreateResponse *resp)
+{
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("create");
+    int parent_fd = posix_find_object(posix, req->parent_inode_n, &req->parent_handle);
+    if (parent_fd <= 0)
+        return -1;
+
+    int fd = -1;
+    struct stat st;
+
+    switch (req->type)
+    {
+        case OBJECT_TYPE_FILE:
+            fd = openat(parent_fd, req->name, O_CREAT | O_WRONLY | O_TRUNC, 0777);
+            break;
+        
+        case OBJECT_TYPE_DIR:
+            if (mkdirat(parent_fd, req->name, 0777) == 0)
+                fd = openat(parent_fd, req->name, 0);
+            break;
+    }
+    if ((fd < 0) || (fchmod(fd, 0777) < 0) || (fstat(fd, &st) < 0))
+    {
+        if (fd >= 0)
+            close(fd);
+        posix_release_fd(posix, parent_fd);
+        return -1;
+    }
+    resp->inode_n = st.st_ino;
+    posix_get_handle(posix, fd, "", &resp->handle);
+    LOG_DEBUG("create: inode_n: %llu", resp->inode_n);
+    index_put(&posix->index, resp->inode_n, req->parent_inode_n, req->name);
+    if (fd != posix->root)
+        close(fd);
+    posix_release_fd(posix, parent_fd);
+    return 0;
+}
+
+static int posix_link(Backend *backend, LinkRequest *req, LinkResponse *resp)
+{
+    (void) resp;
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("link");
+
+    int parent_fd = posix_find_object(posix, req->parent_inode_n, &req->parent_handle);
+    if (parent_fd <= 0)
+        return -1;
+
+    int source_fd = -1;
+    if (posix->use_handles & (req->source_handle.length > 0))
+        source_fd = posix_open_handle(posix, &req->source_handle, req->source_inode_n);
+
+    if (source_fd > 0)
+    {
+        LOG_DEBUG("link: name: %s, source_fd: %d", req->name, source_fd);
+
+        int res = linkat(source_fd, "", parent_fd, req->name, AT_EMPTY_PATH);
+        close(source_fd);
+        if (res < 0)
+        {
+            LOG_ERROR("link: can't linkat");
+            posix_release_fd(posix, parent_fd);
+            return -1;
+        }
+    }
+    else
+    {
+        char *source_name = 0;
+
+        int source_parent_fd = posix_find_parent_dir_and_name_by_inode_n(posix, req->source_inode_n, &source_name);
+        if ((source_parent_fd <= 0) | (source_name == 0))
+        {
+            posix_release_fd(posix, source_parent_fd);
+            posix_release_fd(posix, parent_fd);
+            free(source_name);
+            return -1;
+        }
+
+        LOG_DEBUG("link: name: %s, source_name: %s, source_parent_fd: %d", req->name, source_name, source_parent_fd);
+
+        int res = linkat(source_parent_fd, source_name, parent_fd, req->name, 0);
+        posix_release_fd(posix, source_parent_fd);
+        free(source_name);
+        if (res < 0)
+        {
+            LOG_ERROR("link: can't linkat");
+            posix_release_fd(posix, parent_fd);
+            return -1;
+        }
+    }
+    index_put(&posix->index, req->source_inode_n, req->parent_inode_n, req->name);
+
+    posix_release_fd(posix, parent_fd);
+    return 0;
+}
+
+static int posix_unlink(Backend *backend, UnlinkRequest *req, UnlinkResponse *resp)
+{
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("unlink");
+    int parent_fd = posix_find_object(posix, req->parent_inode_n, &req->parent_handle);
+    if (parent_fd <= 0)
+        return -1;
+
+    struct stat st;
+    if ((fstatat(parent_fd, req->name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+        || (unlinkat(parent_fd, req->name, 0) < 0))
+    {
+        posix_release_fd(posix, parent_fd);
+        return -1;
+    }
+    resp->nlink = st.st_nlink - 1;
+    index_remove_entry(&posix->index, st.st_ino, req->parent_inode_n, req->name);
+    // a cached fd would keep the file alive and could be handed out for a reused inode number
+    fd_cache_invalidate(&posix->fds, st.st_ino);
+    posix_release_fd(posix, parent_fd);
+    return 0;
+}
+
+// only resolves the file and the length to send, the caller sends the range and releases its fd
+static int posix_read(Backend *backend, ReadRequest *req, ReadResponse *resp, FSData *data)
+{
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("read");
+    int fd = posix_find_object(posix, req->inode_n, &req->handle);
+    if (fd <= 0)
+    {
+        LOG_ERROR("read: cant find fd");
+        return -1;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode))
+    {
+        LOG_ERROR("read: not a regular file");
+        posix_release_fd(posix, fd);
+        return -1;
+    }
+
+    uint32_t length = req->length > MAX_DATA_LENGTH ? MAX_DATA_LENGTH : req->length;
+    if (req->offset >= (__u64) st.st_size)
+        length = 0;
+    else if (st.st_size - req->offset < length)
+        length = st.st_size - req->offset;
+    resp->length = length;
+    data->ranges[data->ranges_count++] = (FSRange) { .fd = fd, .offset = req->offset, .length = length };
+
+    LOG_DEBUG("read: %u bytes at %llu", resp->length, req->offset);
+    return 0;
+}
+
+static int posix_write(Backend *backend, WriteRequest *req, WriteResponse *resp, FSData *data)
+{
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("write");
+    int fd = posix_find_object(posix, req->inode_n, &req->handle);
+    if (fd <= 0)
+    {
+        LOG_ERROR("write: cant find fd");
+        return -1;
+    }
+
+    LOG_DEBUG("write: len: %u, off: %llu, fd: %d, ino: %llu", req->length, req->offset, fd, req->inode_n);
+
+    uint32_t done = 0;
+    while (done < req->length)
+    {
+        ssize_t len = pwrite(fd, data->buf + done, req->length - done, req->offset + done);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("write: cant write %s", strerror(errno));
+            posix_release_fd(posix, fd);
+            return -1;
+        }
+        done += len;
+    }
+    resp->length = done;
+    data->buf += done;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0)
+        posix_fill_attrs(&st, &resp->attrs);
+    posix_release_fd(posix, fd);
+    return 0;
+}
+
+void posix_fill_attrs(struct stat *st, ObjectAttrs *attrs)
+{
+    attrs->size = st->st_size;
+    attrs->mtime_sec = st->st_mtim.tv_sec;
+    attrs->mtime_nsec = st->st_mtim.tv_nsec;
+    attrs->nlink = st->st_nlink;
+}
+
+static int posix_list(Backend *backend, ListRequest *req, ListResponse *resp)
+{
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("list: cookie: %llu, plus: %u", req->cookie, req->plus);
+    int fd = posix_find_object(posix, req->inode_n, &req->handle);
+    LOG_DEBUG("list found fd");
+    if (fd <= 0)
+        return -1;
+
+    // the dir stream owns its own fd so the root fd stays untouched
+    int dir_fd = openat(fd, ".", O_RDONLY | O_DIRECTORY);
+    posix_release_fd(posix, fd);
+    if (dir_fd < 0)
+        return -1;
+
+    DIR *dir = fdopendir(dir_fd);
+    if (!dir)
+    {
+        close(dir_fd);
+        return -1;
+    }
+    // cookies are the d_off of the last entry the client got
+    if (req->cookie != 0)
+        seekdir(dir, req->cookie);
+
+    // eof, plus and count come before the entries
+    uint32_t budget = ((req->max_bytes == 0) | (req->max_bytes > WIRE_MAX_BODY_SIZE)) ? WIRE_MAX_BODY_SIZE : req->max_bytes;
+    uint32_t used = 6;
+
+    struct dirent *ent;
+    resp->eof = 0;
+    resp->plus = req->plus != 0;
+    resp->objects.count = 0;
+    while (resp->objects.count < MAX_OBJECTS_COUNT)
+    {
+        if (!(ent = readdir(dir)))
+        {
+            resp->eof = 1;
+            break;
+        }
+        if (!strcmp(ent->d_name, ".") | !strcmp(ent->d_name, ".."))
+            continue;
+
+        Object *obj = &resp->objects.objects[resp->objects.count];
+        memset(obj, 0, sizeof(Object));
+        ObjectType type = ent->d_type == DT_DIR ? OBJECT_TYPE_DIR : OBJECT_TYPE_FILE;
+        if (resp->plus | (ent->d_type == DT_UNKNOWN))
+        {
+            struct stat st;
+            if (fstatat(dir_fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                continue;
+            type = S_ISDIR(st.st_mode) ? OBJECT_TYPE_DIR : OBJECT_TYPE_FILE;
+            posix_fill_attrs(&st, &obj->attrs);
+        }
+
+        obj->info = (ObjectInfo) { .inode_n = ent->d_ino, .type = type };
+        posix_get_handle(posix, dir_fd, ent->d_name, &obj->info.handle);
+        obj->cookie = ent->d_off;
+        strcpy(obj->name, ent->d_name);
+
+        // the entry is sent again by the next call, which resumes at the previous cookie
+        uint32_t size = wire_object_size(obj, resp->plus);
+        if (used + size > budget)
+            break;
+        used += size;
+
+        index_put(&posix->index, ent->d_ino, req->inode_n, ent->d_name);
+        resp->objects.count++;
+    }
+
+    LOG_DEBUG("list: %d objects, eof: %u", resp->objects.count, resp->eof);
+
+    closedir(dir);
+    if ((resp->objects.count == 0) & !resp->eof)
+    {
+        LOG_ERROR("list: max_bytes %u can't fit an entry", req->max_bytes);
+        return -1;
+    }
+    return 0;
+}
+
+static int posix_rmdir(Backend *backend, RmdirRequest *req, RmdirResponse *resp)
+{
+    (void) resp;
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("rmdir");
+    int parent_fd = posix_find_object(posix, req->parent_inode_n, &req->parent_handle);
+    if (parent_fd <= 0)
+        return -1;
+
+    LOG_DEBUG("rmdir: name: %s, parent_ino: %d", req->name, parent_fd);
+
+    struct stat st;
+    if ((fstatat(parent_fd, req->name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+        || (unlinkat(parent_fd, req->name, AT_REMOVEDIR) < 0))
+    {
+        posix_release_fd(posix, parent_fd);
+        return -1;
+    }
+    index_remove_entry(&posix->index, st.st_ino, req->parent_inode_n, req->name);
+    fd_cache_invalidate(&posix->fds, st.st_ino);
+    
+    posix_release_fd(posix, parent_fd);
+    return 0;
+}
+
+static int posix_lookup(Backend *backend, LookupRequest *req, LookupResponse *resp)
+{
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("lookup: %s", req->name);
+    int parent_fd = posix_find_object(posix, req->parent_inode_n, &req->parent_handle);
+    if (parent_fd <= 0)
+    {
+        LOG_DEBUG("lookup not found parent dir");
+        return -1;
+    }
+
+    int fd = openat(parent_fd, req->name, 0);
+    if (fd <= 0)
+    {
+        LOG_DEBUG("lookup cant open");
+        posix_release_fd(posix, parent_fd);
+        return -1;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        LOG_ERROR("lookup cant get stat");
+        posix_release_fd(posix, parent_fd);
+        close(fd);
+        return -1;
+    }
+
+    ObjectType type;
+    if (S_ISDIR(st.st_mode))
+        type = OBJECT_TYPE_DIR;
+    else
+        type = OBJECT_TYPE_FILE;
+    
+    resp->info = (ObjectInfo) { .inode_n = st.st_ino, .type = type };
+    posix_fill_attrs(&st, &resp->attrs);
+    posix_get_handle(posix, fd, "", &resp->info.handle);
+    index_put(&posix->index, st.st_ino, req->parent_inode_n, req->name);
+
+
+    LOG_DEBUG("lookup: %llu", resp->info.inode_n);
+    posix_release_fd(posix, parent_fd);
+    if (fd != posix->root)
+        close(fd);
+    return 0;
+}
+
+static int posix_mount(Backend *backend, MountRequest *req, MountResponse *resp)
+{
+    (void) req;
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("mount");
+    struct stat st;
+    if (fstat(posix->root, &st) < 0)
+        return -1;
+    
+    resp->inode_n = st.st_ino;
+    posix_get_handle(posix, posix->root, "", &resp->handle);
+
+    LOG_DEBUG("mount: %llu", resp->inode_n);
+
+    return 0;
+}
+
+static int posix_getattr(Backend *backend, GetattrRequest *req, GetattrResponse *resp)
+{
+    PosixBackend *posix = (PosixBackend *) backend;
+    LOG_DEBUG("getattr: %llu", req->inode_n);
+    int fd = posix_find_object(posix, req->inode_n, &req->handle);
+    if (fd <= 0)
+        return -1;
+
+    struct stat st;
+    int res = fstat(fd, &st);
+    if (res == 0)
+        posix_fill_attrs(&st, &resp->attrs);
+    posix_release_fd(posix, fd);
+    return res < 0 ? -1 : 0;
+}
+
+static void posix_release(Backend *backend, FSRange *range)
+{
+    // COMPOUND READs come back copied out
+    free(range->buf);
+    posix_release_fd((PosixBackend *) backend, range->fd);
+}
+
+static const BackendOps posix_ops = {
+    .name = "posix",
+    .create = posix_create,
+    .link = posix_link,
+    .unlink = posix_unlink,
+    .read = posix_read,
+    .write = posix_write,
+    .list = posix_list,
+    .rmdir = posix_rmdir,
+    .lookup = posix_lookup,
+    .mount = posix_mount,
+    .getattr = posix_getattr,
+    .release = posix_release,
+    .clean = posix_clean,
+};
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef _POSIX_H
+#define _POSIX_H
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include "backend.h"
+#include "index.h"
+#include "fdcache.h"
+
+#define MAX_PATH_SIZE 4096
+
+// exports a directory of the local file system, objects are opened by handle or by
+// the path the index knows for their inode number
+typedef struct PosixBackend
+{
+    Backend base;
+    int root;
+    Index index;
+    FdCache fds;
+    int use_handles;
+    int root_mount_id;
+} PosixBackend;
+
+int posix_init(PosixBackend *posix, char *path, FSOptions *opts, Stats *stats);
+int posix_find_object(PosixBackend *posix, ino_t inode_n, Handle *handle);
+void posix_release_fd(PosixBackend *posix, int fd);
+void posix_fill_attrs(struct stat *st, ObjectAttrs *attrs);
+
+#endif
\ No newline at end of file
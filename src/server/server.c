@@ -0,0 +1,364 @@
+#include "server.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+#define POOL_QUEUE_SIZE 1024
+
+// a connection with a reply left to send waits for room in the socket, otherwise for the next request
+static int server_arm(Server *server, Connection *conn, int op)
+{
+    struct epoll_event ev = { .events = (conn->reply ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP | EPOLLONESHOT, .data.ptr = conn };
+    return epoll_ctl(server->epoll_fd, op, conn->fd, &ev);
+}
+
+static void server_finish_reply(Connection *conn)
+{
+    for (uint32_t i = 0; i < conn->reply_data.ranges_count; i++)
+        fs_release(conn->server->fs, &conn->reply_data.ranges[i]);
+    free(conn->reply);
+    conn->reply = 0;
+    conn->reply_length = 0;
+    conn->reply_sent = 0;
+    conn->reply_data.ranges_count = 0;
+    conn->range_n = 0;
+    conn->range_sent = 0;
+}
+
+static void server_close(Connection *conn)
+{
+    LOG_DEBUG("closed connection %d", conn->fd);
+    // closing the fd also drops it from the epoll set
+    close(conn->fd);
+    server_finish_reply(conn);
+    free(conn->body);
+    free(conn->data);
+    free(conn);
+}
+
+static void server_reset(Connection *conn)
+{
+    free(conn->body);
+    free(conn->data);
+    conn->body = 0;
+    conn->data = 0;
+    conn->header_read = 0;
+    conn->body_read = 0;
+    conn->data_read = 0;
+}
+
+// > 0 bytes sent, 0 when the socket has no room for now, -1 on error
+static int send_some(int fd, const char *buf, uint32_t len, int flags)
+{
+    while (1)
+    {
+        int res = send(fd, buf, len, flags);
+        if (res >= 0)
+            return res;
+        if ((errno == EAGAIN) | (errno == EWOULDBLOCK))
+            return 0;
+        if (errno != EINTR)
+            return -1;
+    }
+}
+
+// sends the file range straight from the page cache, a file that shrank since
+// the length was announced is padded with zeros to keep the stream in sync
+static int sendfile_some(int fd, int file_fd, off_t offset, uint32_t len)
+{
+    static const char zeros[4096];
+    while (1)
+    {
+        ssize_t res = sendfile(fd, file_fd, &offset, len);
+        if (res > 0)
+            return res;
+        if (res == 0)
+            return send_some(fd, zeros, len > sizeof(zeros) ? sizeof(zeros) : len, 0);
+        if ((errno == EAGAIN) | (errno == EWOULDBLOCK))
+            return 0;
+        if (errno != EINTR)
+            return -1;
+    }
+}
+
+// MSG_MORE while READ data still follows, so that the last piece isn't held back
+static int server_more(Connection *conn, uint32_t range_n)
+{
+    for (uint32_t i = range_n; i < conn->reply_data.ranges_count; i++)
+    {
+        if (conn->reply_data.ranges[i].length > 0)
+            return MSG_MORE;
+    }
+    return 0;
+}
+
+// 1 once the whole reply is out, 0 when the socket is full and the rest waits for EPOLLOUT, -1 on error.
+// A client that doesn't read its replies only stalls its own connection, never the worker
+static int server_flush(Connection *conn)
+{
+    FSData *data = &conn->reply_data;
+    while (conn->reply_sent < conn->reply_length)
+    {
+        int len = send_some(conn->fd, (char *) conn->reply + conn->reply_sent, conn->reply_length - conn->reply_sent, server_more(conn, 0));
+        if (len <= 0)
+            return len;
+        conn->reply_sent += len;
+    }
+    while (conn->range_n < data->ranges_count)
+    {
+        FSRange *range = &data->ranges[conn->range_n];
+        if (conn->range_sent == range->length)
+        {
+            conn->range_n++;
+            conn->range_sent = 0;
+            continue;
+        }
+
+        int len;
+        if (range->buf)
+            len = send_some(conn->fd, range->buf + conn->range_sent, range->length - conn->range_sent, server_more(conn, conn->range_n + 1));
+        else
+            len = sendfile_some(conn->fd, range->fd, range->offset + conn->range_sent, range->length - conn->range_sent);
+        if (len <= 0)
+            return len;
+        conn->range_sent += len;
+    }
+    return 1;
+}
+
+// > 0 bytes read, 0 when the socket has nothing more for now, -1 on error or eof
+static int read_some(int fd, char *buf, uint32_t len)
+{
+    while (1)
+    {
+        int res = read(fd, buf, len);
+        if (res > 0)
+            return res;
+        if (res == 0)
+            return -1;
+        if ((errno == EAGAIN) | (errno == EWOULDBLOCK))
+            return 0;
+        if (errno != EINTR)
+        {
+            LOG_DEBUG("reading err");
+            return -1;
+        }
+    }
+}
+
+// handles the request and leaves the reply on the connection for server_flush
+static int server_process(Server *server, Connection *conn)
+{
+    LOG_DEBUG("got request");
+    MethodRequest req;
+    MethodResponse resp;
+    memset(&resp, 0, sizeof(MethodResponse));
+
+    if (wire_decode_request(&conn->header, conn->body, &req) < 0)
+    {
+        LOG_ERROR("server: malformed request");
+        server_reset(conn);
+        return -1;
+    }
+
+    // WRITE brings its payload along, READ hands back file ranges to send
+    FSData *data = &conn->reply_data;
+    data->buf = conn->data;
+    data->ranges_count = 0;
+    uint64_t start = server->trace ? stats_now() : 0;
+    fs_handle(server->fs, &req, &resp, data);
+
+    int size = wire_encode_response(&resp, 0, 0);
+    uint8_t *buf = size > 0 ? malloc(size) : 0;
+    int encoded = buf && (wire_encode_response(&resp, buf, size) == size);
+    // the time the reply spends waiting for the socket is the client's, not the server's
+    if (server->trace)
+        trace_record(server->trace, conn->connection_n, start, stats_now() - start, conn->header_buf, conn->body, conn->header.body_length,
+                     &resp, buf, encoded ? size : 0);
+    server_reset(conn);
+
+    conn->reply = buf;
+    conn->reply_length = size;
+    if (!encoded)
+    {
+        LOG_ERROR("server: cant encode response");
+        server_finish_reply(conn);
+        return -1;
+    }
+    return 0;
+}
+
+// runs on a worker, epoll won't report the connection again until it is rearmed
+static void serve_connection(void *arg)
+{
+    Connection *conn = arg;
+    Server *server = conn->server;
+
+    while (1)
+    {
+        if (conn->reply)
+        {
+            int res = server_flush(conn);
+            if (res < 0)
+            {
+                LOG_DEBUG("writing err");
+                goto close_conn;
+            }
+            if (res == 0)
+                break;
+            LOG_DEBUG("sent response");
+            server_finish_reply(conn);
+        }
+
+        if (conn->header_read < WIRE_HEADER_SIZE)
+        {
+            int len = read_some(conn->fd, (char *) conn->header_buf + conn->header_read, WIRE_HEADER_SIZE - conn->header_read);
+            if (len < 0)
+                goto close_conn;
+            if (len == 0)
+                break;
+
+            conn->header_read += len;
+            if (conn->header_read < WIRE_HEADER_SIZE)
+                continue;
+
+            if (wire_get_header(conn->header_buf, &conn->header) < 0)
+            {
+                LOG_ERROR("server: request is too long");
+                goto close_conn;
+            }
+            // +1 so that an empty body still gets a valid pointer
+            conn->body = malloc(conn->header.body_length + 1);
+            if (!conn->body)
+                goto close_conn;
+            if (conn->header.data_length > 0)
+            {
+                conn->data = malloc(conn->header.data_length);
+                if (!conn->data)
+                    goto close_conn;
+            }
+        }
+
+        if (conn->body_read < conn->header.body_length)
+        {
+            int len = read_some(conn->fd, (char *) conn->body + conn->body_read, conn->header.body_length - conn->body_read);
+            if (len < 0)
+                goto close_conn;
+            if (len == 0)
+                break;
+
+            conn->body_read += len;
+            if (conn->body_read < conn->header.body_length)
+                continue;
+        }
+
+        if (conn->data_read < conn->header.data_length)
+        {
+            int len = read_some(conn->fd, conn->data + conn->data_read, conn->header.data_length - conn->data_read);
+            if (len < 0)
+                goto close_conn;
+            if (len == 0)
+                break;
+
+            conn->data_read += len;
+            if (conn->data_read < conn->header.data_length)
+                continue;
+        }
+
+        if (server_process(server, conn) < 0)
+            goto close_conn;
+    }
+
+    if (server_arm(server, conn, EPOLL_CTL_MOD) < 0)
+    {
+        LOG_ERROR("server: cant rearm connection");
+        goto close_conn;
+    }
+    return;
+
+    close_conn:
+    server_close(conn);
+}
+
+static void server_accept(Server *server)
+{
+    while (1)
+    {
+        int connfd = accept4(server->listen_fd, 0, 0, SOCK_NONBLOCK);
+        if (connfd < 0)
+        {
+            if ((errno != EAGAIN) & (errno != EWOULDBLOCK))
+                LOG_DEBUG("accept error");
+            return;
+        }
+
+        Connection *conn = calloc(1, sizeof(Connection));
+        if (!conn)
+        {
+            close(connfd);
+            continue;
+        }
+        conn->fd = connfd;
+        conn->connection_n = server->connections_count++;
+        conn->server = server;
+
+        if (server_arm(server, conn, EPOLL_CTL_ADD) < 0)
+        {
+            LOG_ERROR("server: cant add connection");
+            server_close(conn);
+            continue;
+        }
+        LOG_DEBUG("got connection %d", connfd);
+    }
+}
+
+int server_init(Server *server, FS *fs, Trace *trace, int listen_fd, uint32_t threads_count)
+{
+    server->fs = fs;
+    server->trace = trace;
+    server->listen_fd = listen_fd;
+    server->connections_count = 0;
+
+    int flags = fcntl(listen_fd, F_GETFL, 0);
+    if ((flags < 0) || (fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) < 0))
+        return -1;
+
+    server->epoll_fd = epoll_create1(0);
+    if (server->epoll_fd < 0)
+        return -1;
+
+    // listen socket is identified by a null data pointer
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = 0 };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+        return -1;
+
+    if (pool_init(&server->pool, threads_count, POOL_QUEUE_SIZE) < 0)
+        return -1;
+    return 0;
+}
+
+void server_run(Server *server)
+{
+    struct epoll_event events[MAX_EVENTS];
+    while (1)
+    {
+        int n = epoll_wait(server->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno != EINTR)
+                LOG_ERROR("server: epoll_wait failed");
+            continue;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == 0)
+                server_accept(server);
+            else
+                pool_submit(&server->pool, serve_connection, events[i].data.ptr);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include "fs.h"
+#include "pool.h"
+#include "trace.h"
+#include "../shared/wire.h"
+
+#define MAX_EVENTS 256
+
+typedef struct Connection
+{
+    int fd;
+    uint32_t connection_n;
+    uint8_t header_buf[WIRE_HEADER_SIZE];
+    uint32_t header_read;
+    WireHeader header;
+    uint8_t *body;
+    uint32_t body_read;
+    char *data;
+    uint32_t data_read;
+    // the reply being sent: the encoded header and body, then the READ data ranges
+    uint8_t *reply;
+    uint32_t reply_length;
+    uint32_t reply_sent;
+    FSData reply_data;
+    uint32_t range_n;
+    uint32_t range_sent;
+    struct Server *server;
+} Connection;
+
+typedef struct Server
+{
+    FS *fs;
+    // null when requests aren't traced
+    Trace *trace;
+    Pool pool;
+    int listen_fd;
+    int epoll_fd;
+    uint32_t connections_count;
+} Server;
+
+int server_init(Server *server, FS *fs, Trace *trace, int listen_fd, uint32_t threads_count);
+void server_run(Server *server);
+
+#endif
\ No newline at end of file
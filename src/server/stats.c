@@ -0,0 +1,301 @@
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define STATS_REQUEST_TIMEOUT_MS 1000
+
+static const char *method_names[STATS_MAX_METHODS] = {
+    [METHOD_TYPE_CREATE] = "create",
+    [METHOD_TYPE_LINK] = "link",
+    [METHOD_TYPE_UNLINK] = "unlink",
+    [METHOD_TYPE_READ] = "read",
+    [METHOD_TYPE_WRITE] = "write",
+    [METHOD_TYPE_LIST] = "list",
+    [METHOD_TYPE_RMDIR] = "rmdir",
+    [METHOD_TYPE_LOOKUP] = "lookup",
+    [METHOD_TYPE_MOUNT] = "mount",
+    [METHOD_TYPE_COMPOUND] = "compound",
+    [METHOD_TYPE_STATS] = "stats",
+    [METHOD_TYPE_GETATTR] = "getattr",
+};
+
+static const char *resolve_path_names[STATS_RESOLVE_PATHS_COUNT] = {
+    [STATS_RESOLVE_ROOT] = "root",
+    [STATS_RESOLVE_CACHE] = "cache",
+    [STATS_RESOLVE_HANDLE] = "handle",
+    [STATS_RESOLVE_INDEX] = "index",
+    [STATS_RESOLVE_REBUILD] = "rebuild",
+    [STATS_RESOLVE_MISS] = "miss",
+};
+
+// resolution time of the request the worker is handling
+static __thread uint64_t resolve_ns;
+
+void stats_init(Stats *stats)
+{
+    memset(stats, 0, sizeof(Stats));
+    stats->started_ns = stats_now();
+}
+
+uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stats_add_resolve(uint64_t ns)
+{
+    resolve_ns += ns;
+}
+
+uint64_t stats_take_resolve(void)
+{
+    uint64_t ns = resolve_ns;
+    resolve_ns = 0;
+    return ns;
+}
+
+void stats_count_resolve(Stats *stats, StatsResolvePath path)
+{
+    atomic_fetch_add_explicit(&stats->resolve_paths[path], 1, memory_order_relaxed);
+}
+
+static uint32_t histogram_bucket(uint64_t value)
+{
+    if (value < (1 << STATS_SUB_BITS))
+        return value;
+    uint32_t exponent = 63 - __builtin_clzll(value);
+    if (exponent > STATS_MAX_EXPONENT)
+        return STATS_BUCKETS_COUNT - 1;
+    uint32_t sub = (value >> (exponent - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1);
+    return ((exponent - STATS_SUB_BITS + 1) << STATS_SUB_BITS) + sub;
+}
+
+// largest value that falls into the bucket
+static uint64_t histogram_bucket_limit(uint32_t bucket)
+{
+    if (bucket < (1 << STATS_SUB_BITS))
+        return bucket;
+    uint32_t exponent = (bucket >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1 << STATS_SUB_BITS) - 1);
+    uint32_t shift = exponent - STATS_SUB_BITS;
+    return (((1ULL << STATS_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+static void histogram_add(Histogram *histogram, uint64_t value)
+{
+    atomic_fetch_add_explicit(&histogram->buckets[histogram_bucket(value)], 1, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while ((value > max) && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed, memory_order_relaxed));
+}
+
+static void histogram_summary(Histogram *histogram, LatencySummary *summary)
+{
+    uint64_t counts[STATS_BUCKETS_COUNT];
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < STATS_BUCKETS_COUNT; i++)
+    {
+        counts[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        total += counts[i];
+    }
+
+    // ranks are rounded up, p999 of 10 samples is the largest one
+    uint64_t ranks[3] = { (total * 500 + 999) / 1000, (total * 990 + 999) / 1000, (total * 999 + 999) / 1000 };
+    __u64 *values[3] = { &summary->p50, &summary->p99, &summary->p999 };
+    uint64_t seen = 0;
+    uint32_t next = 0;
+    memset(summary, 0, sizeof(LatencySummary));
+    summary->max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    for (uint32_t i = 0; (i < STATS_BUCKETS_COUNT) & (next < 3); i++)
+    {
+        seen += counts[i];
+        while ((next < 3) && (seen >= ranks[next]) && (seen > 0))
+        {
+            uint64_t limit = histogram_bucket_limit(i);
+            *values[next++] = limit < summary->max ? limit : summary->max;
+        }
+    }
+}
+
+void stats_record(Stats *stats, uint32_t type, int failed, uint64_t bytes, uint64_t total_ns, uint64_t resolve_ns)
+{
+    if (type >= STATS_MAX_METHODS)
+        return;
+    StatsCounters *counters = &stats->methods[type];
+    atomic_fetch_add_explicit(&counters->count, 1, memory_order_relaxed);
+    if (failed)
+        atomic_fetch_add_explicit(&counters->errors, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counters->bytes, bytes, memory_order_relaxed);
+    histogram_add(&counters->total, total_ns);
+    histogram_add(&counters->resolve, resolve_ns);
+    histogram_add(&counters->syscall, total_ns > resolve_ns ? total_ns - resolve_ns : 0);
+}
+
+void stats_snapshot(Stats *stats, StatsResponse *resp)
+{
+    resp->uptime_ns = stats_now() - stats->started_ns;
+    for (uint32_t i = 0; i < STATS_RESOLVE_PATHS_COUNT; i++)
+        resp->resolve_paths[i] = atomic_load_explicit(&stats->resolve_paths[i], memory_order_relaxed);
+    for (uint32_t i = 0; i < STATS_MAX_METHODS; i++)
+    {
+        StatsCounters *counters = &stats->methods[i];
+        MethodStats *method = &resp->methods[i];
+        method->count = atomic_load_explicit(&counters->count, memory_order_relaxed);
+        method->errors = atomic_load_explicit(&counters->errors, memory_order_relaxed);
+        method->bytes = atomic_load_explicit(&counters->bytes, memory_order_relaxed);
+        histogram_summary(&counters->total, &method->total);
+        histogram_summary(&counters->resolve, &method->resolve);
+        histogram_summary(&counters->syscall, &method->syscall);
+    }
+}
+
+const char * stats_method_name(uint32_t type)
+{
+    if ((type >= STATS_MAX_METHODS) || !method_names[type])
+        return 0;
+    return method_names[type];
+}
+
+static void dump_latency_text(FILE *out, const char *name, LatencySummary *latency)
+{
+    fprintf(out, "  %-8s p50 %10llu  p99 %10llu  p999 %10llu  max %10llu ns\n", name,
+            (unsigned long long) latency->p50, (unsigned long long) latency->p99,
+            (unsigned long long) latency->p999, (unsigned long long) latency->max);
+}
+
+void stats_dump_text(StatsResponse *resp, FILE *out)
+{
+    fprintf(out, "uptime %.3f s\n", resp->uptime_ns / 1e9);
+    fprintf(out, "resolve:");
+    for (uint32_t i = 0; i < STATS_RESOLVE_PATHS_COUNT; i++)
+        fprintf(out, " %s %llu", resolve_path_names[i], (unsigned long long) resp->resolve_paths[i]);
+    fprintf(out, "\n");
+
+    for (uint32_t i = 0; i < STATS_MAX_METHODS; i++)
+    {
+        MethodStats *method = &resp->methods[i];
+        if (!stats_method_name(i) | (method->count == 0))
+            continue;
+        fprintf(out, "%s: count %llu errors %llu bytes %llu\n", stats_method_name(i),
+                (unsigned long long) method->count, (unsigned long long) method->errors, (unsigned long long) method->bytes);
+        dump_latency_text(out, "total", &method->total);
+        dump_latency_text(out, "resolve", &method->resolve);
+        dump_latency_text(out, "syscall", &method->syscall);
+    }
+}
+
+static void dump_latency_json(FILE *out, const char *name, LatencySummary *latency, const char *sep)
+{
+    fprintf(out, "\"%s\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}%s", name,
+            (unsigned long long) latency->p50, (unsigned long long) latency->p99,
+            (unsigned long long) latency->p999, (unsigned long long) latency->max, sep);
+}
+
+void stats_dump_json(StatsResponse *resp, FILE *out)
+{
+    fprintf(out, "{\"uptime_ns\": %llu, \"resolve\": {", (unsigned long long) resp->uptime_ns);
+    for (uint32_t i = 0; i < STATS_RESOLVE_PATHS_COUNT; i++)
+        fprintf(out, "%s\"%s\": %llu", i ? ", " : "", resolve_path_names[i], (unsigned long long) resp->resolve_paths[i]);
+    fprintf(out, "}, \"methods\": {");
+
+    int first = 1;
+    for (uint32_t i = 0; i < STATS_MAX_METHODS; i++)
+    {
+        MethodStats *method = &resp->methods[i];
+        if (!stats_method_name(i))
+            continue;
+        fprintf(out, "%s\"%s\": {\"count\": %llu, \"errors\": %llu, \"bytes\": %llu, ", first ? "" : ", ", stats_method_name(i),
+                (unsigned long long) method->count, (unsigned long long) method->errors, (unsigned long long) method->bytes);
+        dump_latency_json(out, "total", &method->total, ", ");
+        dump_latency_json(out, "resolve", &method->resolve, ", ");
+        dump_latency_json(out, "syscall", &method->syscall, "}");
+        first = 0;
+    }
+    fprintf(out, "}}\n");
+}
+
+typedef struct StatsListener
+{
+    Stats *stats;
+    int fd;
+} StatsListener;
+
+// every connection gets one dump, JSON if it starts with "json" and text otherwise
+static void * stats_serve(void *arg)
+{
+    StatsListener *listener = arg;
+    while (1)
+    {
+        int fd = accept(listener->fd, 0, 0);
+        if (fd < 0)
+            continue;
+
+        char request[16] = { 0 };
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, STATS_REQUEST_TIMEOUT_MS) > 0)
+        {
+            if (read(fd, request, sizeof(request) - 1) < 0)
+                request[0] = 0;
+        }
+
+        FILE *out = fdopen(fd, "w");
+        if (!out)
+        {
+            close(fd);
+            continue;
+        }
+        StatsResponse resp;
+        stats_snapshot(listener->stats, &resp);
+        if (!strncmp(request, "json", 4))
+            stats_dump_json(&resp, out);
+        else
+            stats_dump_text(&resp, out);
+        fclose(out);
+    }
+    return 0;
+}
+
+int stats_listen(Stats *stats, const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    if ((bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) || (listen(fd, 16) < 0))
+    {
+        close(fd);
+        return -1;
+    }
+
+    StatsListener *listener = malloc(sizeof(StatsListener));
+    if (!listener)
+    {
+        close(fd);
+        return -1;
+    }
+    listener->stats = stats;
+    listener->fd = fd;
+
+    pthread_t thread;
+    if (pthread_create(&thread, 0, stats_serve, listener) != 0)
+    {
+        close(fd);
+        free(listener);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
\ No newline at end of file
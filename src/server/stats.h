@@ -0,0 +1,51 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "../shared/protocol.h"
+
+// log-linear buckets: exact below 2^STATS_SUB_BITS ns, then 2^STATS_SUB_BITS buckets per power of two
+#define STATS_SUB_BITS 3
+#define STATS_MAX_EXPONENT 40
+#define STATS_BUCKETS_COUNT (((STATS_MAX_EXPONENT - STATS_SUB_BITS) + 2) << STATS_SUB_BITS)
+
+typedef struct Histogram
+{
+    atomic_uint_fast64_t buckets[STATS_BUCKETS_COUNT];
+    atomic_uint_fast64_t max;
+} Histogram;
+
+typedef struct StatsCounters
+{
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t errors;
+    atomic_uint_fast64_t bytes;
+    Histogram total;
+    Histogram resolve;
+    Histogram syscall;
+} StatsCounters;
+
+// updated by all workers without locks, readers take a snapshot
+typedef struct Stats
+{
+    uint64_t started_ns;
+    atomic_uint_fast64_t resolve_paths[STATS_RESOLVE_PATHS_COUNT];
+    StatsCounters methods[STATS_MAX_METHODS];
+} Stats;
+
+void stats_init(Stats *stats);
+uint64_t stats_now(void);
+void stats_add_resolve(uint64_t ns);
+uint64_t stats_take_resolve(void);
+void stats_count_resolve(Stats *stats, StatsResolvePath path);
+void stats_record(Stats *stats, uint32_t type, int failed, uint64_t bytes, uint64_t total_ns, uint64_t resolve_ns);
+void stats_snapshot(Stats *stats, StatsResponse *resp);
+const char * stats_method_name(uint32_t type);
+void stats_dump_text(StatsResponse *resp, FILE *out);
+void stats_dump_json(StatsResponse *resp, FILE *out);
+int stats_listen(Stats *stats, const char *path);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "trace.h"
+#include "stats.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static int trace_write_full(int fd, const uint8_t *buf, uint32_t len)
+{
+    while (len > 0)
+    {
+        ssize_t res = write(fd, buf, len);
+        if ((res < 0) && (errno == EINTR))
+            continue;
+        if (res <= 0)
+            return -1;
+        buf += res;
+        len -= res;
+    }
+    return 0;
+}
+
+// swaps the buffers so that appends go on while the full one is written
+void trace_flush(Trace *trace)
+{
+    pthread_mutex_lock(&trace->write_lock);
+    pthread_mutex_lock(&trace->lock);
+    uint8_t *buf = trace->buf;
+    uint32_t used = trace->used;
+    trace->buf = trace->spare;
+    trace->spare = buf;
+    trace->used = 0;
+    pthread_mutex_unlock(&trace->lock);
+
+    if ((used > 0) && (trace_write_full(trace->fd, buf, used) < 0))
+        LOG_ERROR("trace: cant write %s", strerror(errno));
+    pthread_mutex_unlock(&trace->write_lock);
+}
+
+static void * trace_flusher(void *arg)
+{
+    Trace *trace = arg;
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = TRACE_FLUSH_INTERVAL_MS * 1000000L };
+    while (1)
+    {
+        nanosleep(&interval, 0);
+        trace_flush(trace);
+    }
+    return 0;
+}
+
+int trace_open(Trace *trace, const char *path)
+{
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace->fd < 0)
+        return -1;
+    if (trace_write_full(trace->fd, (const uint8_t *) TRACE_MAGIC, TRACE_MAGIC_SIZE) < 0)
+        return -1;
+
+    trace->buf = malloc(TRACE_BUFFER_SIZE);
+    trace->spare = malloc(TRACE_BUFFER_SIZE);
+    if (!trace->buf | !trace->spare)
+        return -1;
+    trace->used = 0;
+    trace->started_ns = stats_now();
+    if ((pthread_mutex_init(&trace->lock, 0) != 0) | (pthread_mutex_init(&trace->write_lock, 0) != 0))
+        return -1;
+
+    pthread_t thread;
+    if (pthread_create(&thread, 0, trace_flusher, trace) != 0)
+        return -1;
+    pthread_detach(thread);
+    return 0;
+}
+
+// header and body are the request as it was read, the WRITE payload isn't recorded.
+// response is the encoded reply, it is kept only when it names objects
+void trace_record(Trace *trace, uint32_t connection_n, uint64_t start_ns, uint64_t latency_ns,
+                  const uint8_t *header, const uint8_t *body, uint32_t body_length,
+                  const MethodResponse *resp, const uint8_t *response, uint32_t response_length)
+{
+    if (!trace_keeps_response(resp->type))
+        response_length = 0;
+    TraceRecord record = {
+        .time_ns = start_ns - trace->started_ns,
+        .latency_ns = latency_ns,
+        .connection_n = connection_n,
+        .status = resp->status,
+        .response_length = response_length,
+    };
+    uint32_t request_size = TRACE_RECORD_SIZE + WIRE_HEADER_SIZE + body_length;
+    uint32_t size = request_size + response_length;
+
+    pthread_mutex_lock(&trace->lock);
+    while (trace->used + size > TRACE_BUFFER_SIZE)
+    {
+        pthread_mutex_unlock(&trace->lock);
+        trace_flush(trace);
+        pthread_mutex_lock(&trace->lock);
+    }
+    trace_put_record(trace->buf + trace->used, &record);
+    memcpy(trace->buf + trace->used + TRACE_RECORD_SIZE, header, WIRE_HEADER_SIZE);
+    memcpy(trace->buf + trace->used + TRACE_RECORD_SIZE + WIRE_HEADER_SIZE, body, body_length);
+    if (response_length > 0)
+        memcpy(trace->buf + trace->used + request_size, response, response_length);
+    trace->used += size;
+    pthread_mutex_unlock(&trace->lock);
+}
\ No newline at end of file
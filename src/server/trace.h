@@ -0,0 +1,31 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../shared/trace.h"
+
+// entries are collected in memory and written out by a background thread
+#define TRACE_BUFFER_SIZE (4 * 1024 * 1024)
+#define TRACE_FLUSH_INTERVAL_MS 100
+
+typedef struct Trace
+{
+    int fd;
+    uint64_t started_ns;
+    // appends take only lock, writing the full buffer out also holds write_lock
+    pthread_mutex_t lock;
+    pthread_mutex_t write_lock;
+    uint8_t *buf;
+    uint8_t *spare;
+    uint32_t used;
+} Trace;
+
+int trace_open(Trace *trace, const char *path);
+void trace_record(Trace *trace, uint32_t connection_n, uint64_t start_ns, uint64_t latency_ns,
+                  const uint8_t *header, const uint8_t *body, uint32_t body_length,
+                  const MethodResponse *resp, const uint8_t *response, uint32_t response_length);
+void trace_flush(Trace *trace);
+
+#endif
\ No newline at end of file
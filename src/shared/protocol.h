@@ -6,14 +6,21 @@
 #define ROOT_DIR_INODE_N 1337
 #define MAX_NAME_SIZE 256
 #define MAX_OBJECTS_COUNT 32
-#define MAX_DATA_LENGTH 1024
+// upper bound of the rsize/wsize negotiated at mount time
+#define MAX_DATA_LENGTH (1 << 20)
+#define MAX_HANDLE_SIZE 128
+#define MAX_COMPOUND_OPS 8
+// STATS reports every method type below this, indexed by MethodType
+#define STATS_MAX_METHODS 16
 
 
-typedef struct Data
+// opaque kernel file handle, length == 0 means the object is referred by inode_n only
+typedef struct Handle
 {
-    int length;
-    char data[MAX_DATA_LENGTH];
-} Data;
+    __u32 type;
+    __u32 length;
+    __u8 bytes[MAX_HANDLE_SIZE];
+} Handle;
 
 
 
@@ -25,19 +32,32 @@ typedef enum ObjectType
 
 typedef struct ObjectInfo
 {
-    ObjectType type;
-    unsigned long inode_n;
+    __u32 type;
+    __u64 inode_n;
+    Handle handle;
 } ObjectInfo;
 
+// what READDIRPLUS and LOOKUP return on top of ObjectInfo
+typedef struct ObjectAttrs
+{
+    __u64 size;
+    __s64 mtime_sec;
+    __u32 mtime_nsec;
+    __u32 nlink;
+} ObjectAttrs;
+
+// cookie resumes the listing right after this entry
 typedef struct Object
 {
     ObjectInfo info;
+    ObjectAttrs attrs;
+    __u64 cookie;
     char name[MAX_NAME_SIZE];
 } Object;
 
 typedef struct Objects
 {
-    unsigned short count;
+    __u32 count;
     Object objects[MAX_OBJECTS_COUNT];
 } Objects;
 
@@ -53,6 +73,9 @@ typedef enum MethodType
     METHOD_TYPE_RMDIR,
     METHOD_TYPE_LOOKUP,
     METHOD_TYPE_MOUNT,
+    METHOD_TYPE_COMPOUND,
+    METHOD_TYPE_STATS,
+    METHOD_TYPE_GETATTR,
 } MethodType;
 
 
@@ -63,31 +86,42 @@ typedef enum MethodStatus
 } MethodStatus;
 
 
-typedef struct MountRequest {} MountRequest;
+typedef struct MountRequest
+{
+    __u32 rsize;
+    __u32 wsize;
+} MountRequest;
 
 typedef struct MountResponse
 {
-    unsigned long inode_n;
+    __u64 inode_n;
+    Handle handle;
+    __u32 rsize;
+    __u32 wsize;
 } MountResponse;
 
 
 typedef struct CreateRequest
 {
-    ObjectType type;
-    unsigned long parent_inode_n;
+    __u32 type;
+    __u64 parent_inode_n;
+    Handle parent_handle;
     char name[MAX_NAME_SIZE];
 } CreateRequest;
 
 typedef struct CreateResponse
 {
-    unsigned long inode_n;
+    __u64 inode_n;
+    Handle handle;
 } CreateResponse;
 
 
 typedef struct LinkRequest
 {
-    unsigned long source_inode_n;
-    unsigned long parent_inode_n;
+    __u64 source_inode_n;
+    Handle source_handle;
+    __u64 parent_inode_n;
+    Handle parent_handle;
     char name[MAX_NAME_SIZE];
 } LinkRequest;
 
@@ -96,47 +130,74 @@ typedef struct LinkResponse {} LinkResponse;
 
 typedef struct UnlinkRequest
 {
-    unsigned long parent_inode_n;
+    __u64 parent_inode_n;
+    Handle parent_handle;
     char name[MAX_NAME_SIZE];
 } UnlinkRequest;
 
-typedef struct UnlinkResponse {} UnlinkResponse;
+// links the object has left, at 0 it is gone once nobody has it open
+typedef struct UnlinkResponse
+{
+    __u32 nlink;
+} UnlinkResponse;
+
 
+// file data isn't part of the structs: a READ response and a WRITE request
+// carry length bytes of data after their body, see wire.h
 
 typedef struct ReadRequest
 {
-    unsigned long inode_n;
+    __u64 inode_n;
+    Handle handle;
+    __u64 offset;
+    __u32 length;
 } ReadRequest;
 
 typedef struct ReadResponse
 {
-    Data data;
+    __u32 length;
 } ReadResponse;
 
 
 typedef struct WriteRequest
 {
-    unsigned long inode_n;
-    Data data;
+    __u64 inode_n;
+    Handle handle;
+    __u64 offset;
+    __u32 length;
 } WriteRequest;
 
-typedef struct WriteResponse {} WriteResponse;
+// attrs are the ones of the file after the write, so the writer can tell its own changes apart
+typedef struct WriteResponse
+{
+    __u32 length;
+    ObjectAttrs attrs;
+} WriteResponse;
 
 
+// cookie 0 starts from the beginning, max_bytes bounds the encoded reply,
+// plus asks for the attributes of every entry as well (READDIRPLUS)
 typedef struct ListRequest
 {
-    unsigned long inode_n;
+    __u64 inode_n;
+    Handle handle;
+    __u64 cookie;
+    __u32 max_bytes;
+    __u32 plus;
 } ListRequest;
 
 typedef struct ListResponse
 {
+    __u32 eof;
+    __u32 plus;
     Objects objects;
 } ListResponse;
 
 
 typedef struct RmdirRequest
 {
-    unsigned long parent_inode_n;
+    __u64 parent_inode_n;
+    Handle parent_handle;
     char name[MAX_NAME_SIZE];
 } RmdirRequest;
 
@@ -145,19 +206,135 @@ typedef struct RmdirResponse {} RmdirResponse;
 
 typedef struct LookupRequest
 {
-    unsigned long parent_inode_n;
+    __u64 parent_inode_n;
+    Handle parent_handle;
     char name[MAX_NAME_SIZE];
 } LookupRequest;
 
 typedef struct LookupResponse
 {
     ObjectInfo info;
+    ObjectAttrs attrs;
 } LookupResponse;
 
 
+typedef struct GetattrRequest
+{
+    __u64 inode_n;
+    Handle handle;
+} GetattrRequest;
+
+typedef struct GetattrResponse
+{
+    ObjectAttrs attrs;
+} GetattrResponse;
+
+
+// COMPOUND runs up to MAX_COMPOUND_OPS operations in order and stops at the first one that fails.
+// Any inode_n of an op may be COMPOUND_RESULT_INODE_N(i) to refer to the object created or looked
+// up by op i, its handle is taken along. WRITE data of all ops and READ data of all successful ops
+// follow the body back to back in op order. LIST, MOUNT, GETATTR and COMPOUND can't be nested.
+
+#define COMPOUND_RESULT_INODE_N(op) (~(__u64) 0 - (op))
+
+static inline int compound_result_op(__u64 inode_n)
+{
+    return inode_n > COMPOUND_RESULT_INODE_N(MAX_COMPOUND_OPS) ? (int) (~(__u64) 0 - inode_n) : -1;
+}
+
+typedef struct CompoundOpRequest
+{
+    __u32 type;
+    union
+    {
+        CreateRequest create;
+        LinkRequest link;
+        UnlinkRequest unlink;
+        ReadRequest read;
+        WriteRequest write;
+        RmdirRequest rmdir;
+        LookupRequest lookup;
+    };
+} CompoundOpRequest;
+
+typedef struct CompoundOpResponse
+{
+    __u32 status;
+    __u32 type;
+    union
+    {
+        CreateResponse create;
+        LinkResponse link;
+        UnlinkResponse unlink;
+        ReadResponse read;
+        WriteResponse write;
+        RmdirResponse rmdir;
+        LookupResponse lookup;
+    };
+} CompoundOpResponse;
+
+typedef struct CompoundRequest
+{
+    __u32 count;
+    CompoundOpRequest ops[MAX_COMPOUND_OPS];
+} CompoundRequest;
+
+// count is the number of ops that ran, the last one failed if the call did
+typedef struct CompoundResponse
+{
+    __u32 count;
+    CompoundOpResponse ops[MAX_COMPOUND_OPS];
+} CompoundResponse;
+
+
+// how fs_find_object got to an object
+typedef enum StatsResolvePath
+{
+    STATS_RESOLVE_ROOT = 0,
+    STATS_RESOLVE_CACHE,
+    STATS_RESOLVE_HANDLE,
+    STATS_RESOLVE_INDEX,
+    STATS_RESOLVE_REBUILD,
+    STATS_RESOLVE_MISS,
+    STATS_RESOLVE_PATHS_COUNT,
+} StatsResolvePath;
+
+// latencies in ns, taken from log-linear histograms so they are rounded up by at most 1/8
+typedef struct LatencySummary
+{
+    __u64 p50;
+    __u64 p99;
+    __u64 p999;
+    __u64 max;
+} LatencySummary;
+
+// resolve is the time spent finding the objects, syscall the rest of the handler
+typedef struct MethodStats
+{
+    __u64 count;
+    __u64 errors;
+    __u64 bytes;
+    LatencySummary total;
+    LatencySummary resolve;
+    LatencySummary syscall;
+} MethodStats;
+
+typedef struct StatsRequest {} StatsRequest;
+
+typedef struct StatsResponse
+{
+    __u64 uptime_ns;
+    __u64 resolve_paths[STATS_RESOLVE_PATHS_COUNT];
+    MethodStats methods[STATS_MAX_METHODS];
+} StatsResponse;
+
+
+// the structs below are the decoded form, wire.h defines how they are framed on the socket.
+// xid is chosen by the client and echoed back, it matches pipelined responses to requests
 typedef struct MethodRequest
 {
-    MethodType type;
+    __u32 type;
+    __u32 xid;
     union
     {
         CreateRequest create;
@@ -169,14 +346,18 @@ typedef struct MethodRequest
         RmdirRequest rmdir;
         LookupRequest lookup;
         MountRequest mount;
+        CompoundRequest compound;
+        StatsRequest stats;
+        GetattrRequest getattr;
     };
 } MethodRequest;
 
 
 typedef struct MethodResponse
 {
-    MethodStatus status;
-    MethodType type;
+    __u32 status;
+    __u32 type;
+    __u32 xid;
     union
     {
         CreateResponse create;
@@ -188,9 +369,45 @@ typedef struct MethodResponse
         RmdirResponse rmdir;
         LookupResponse lookup;
         MountResponse mount;
+        CompoundResponse compound;
+        StatsResponse stats;
+        GetattrResponse getattr;
     };
 } MethodResponse;
 
 
+// summed in 64 bits so that op lengths can't wrap around to a small total
+static inline __u64 method_request_data_length(const MethodRequest *req)
+{
+    if (req->type == METHOD_TYPE_COMPOUND)
+    {
+        __u64 length = 0;
+        for (__u32 i = 0; (i < req->compound.count) & (i < MAX_COMPOUND_OPS); i++)
+        {
+            if (req->compound.ops[i].type == METHOD_TYPE_WRITE)
+                length += req->compound.ops[i].write.length;
+        }
+        return length;
+    }
+    return req->type == METHOD_TYPE_WRITE ? req->write.length : 0;
+}
+
+static inline __u64 method_response_data_length(const MethodResponse *resp)
+{
+    // a failed COMPOUND still returns the data of the ops that succeeded
+    if (resp->type == METHOD_TYPE_COMPOUND)
+    {
+        __u64 length = 0;
+        for (__u32 i = 0; (i < resp->compound.count) & (i < MAX_COMPOUND_OPS); i++)
+        {
+            if ((resp->compound.ops[i].type == METHOD_TYPE_READ) & (resp->compound.ops[i].status == METHOD_STATUS_OK))
+                length += resp->compound.ops[i].read.length;
+        }
+        return length;
+    }
+    return ((resp->type == METHOD_TYPE_READ) & (resp->status == METHOD_STATUS_OK)) ? resp->read.length : 0;
+}
+
+
 
 #endif
\ No newline at end of file
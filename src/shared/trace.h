@@ -0,0 +1,66 @@
+#ifndef _TRACE_FORMAT_H
+#define _TRACE_FORMAT_H
+
+#include "wire.h"
+
+// A trace file is TRACE_MAGIC followed by one entry per request in the order the
+// server finished them. An entry is a TRACE_RECORD_SIZE record header followed by
+// the request exactly as it came off the socket: the wire header and the body.
+// WRITE payloads aren't kept, the wire header still tells how long they were.
+// Replies that name objects (see trace_keeps_response) follow as response_length
+// bytes of wire header and body, so a replay can map those objects to its own.
+//
+// record: u64 time_ns | u64 latency_ns | u32 connection_n | u32 status | u32 response_length
+//
+// time_ns counts from the start of the trace.
+
+#define TRACE_MAGIC "PNFSTRC3"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_RECORD_SIZE 28
+
+typedef struct TraceRecord
+{
+    __u64 time_ns;
+    __u64 latency_ns;
+    __u32 connection_n;
+    __u32 status;
+    __u32 response_length;
+} TraceRecord;
+
+static inline void trace_put_record(__u8 *buf, const TraceRecord *record)
+{
+    WireBuf b = { .data = buf, .size = TRACE_RECORD_SIZE };
+    wire_put_u64(&b, record->time_ns);
+    wire_put_u64(&b, record->latency_ns);
+    wire_put_u32(&b, record->connection_n);
+    wire_put_u32(&b, record->status);
+    wire_put_u32(&b, record->response_length);
+}
+
+static inline void trace_get_record(const __u8 *buf, TraceRecord *record)
+{
+    WireBuf b = { .data = (__u8 *) buf, .size = TRACE_RECORD_SIZE };
+    record->time_ns = wire_get_u64(&b);
+    record->latency_ns = wire_get_u64(&b);
+    record->connection_n = wire_get_u32(&b);
+    record->status = wire_get_u32(&b);
+    record->response_length = wire_get_u32(&b);
+}
+
+// replies that hand out inode numbers the client may use in later requests
+static inline int trace_keeps_response(__u32 type)
+{
+    switch (type)
+    {
+        case METHOD_TYPE_CREATE:
+        case METHOD_TYPE_LOOKUP:
+        case METHOD_TYPE_MOUNT:
+        case METHOD_TYPE_LIST:
+        case METHOD_TYPE_COMPOUND:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,833 @@
+#ifndef _WIRE_H
+#define _WIRE_H
+
+#include "protocol.h"
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#else
+#include <string.h>
+#endif
+
+// Every message on the socket is a fixed 16 byte header followed by body_length
+// bytes of encoded fields and data_length bytes of file data (READ responses and
+// WRITE requests only). All integers are little-endian, names and handles are
+// length-prefixed, and error responses have an empty body except for COMPOUND.
+//
+// header: u32 body_length | u32 data_length | u16 type | u16 status | u32 xid
+
+#define WIRE_HEADER_SIZE 16
+#define WIRE_MAX_BODY_SIZE (64 * 1024)
+
+typedef struct WireHeader
+{
+    __u32 body_length;
+    __u32 data_length;
+    __u16 type;
+    __u16 status;
+    __u32 xid;
+} WireHeader;
+
+// a null data pointer only measures how much would be written
+typedef struct WireBuf
+{
+    __u8 *data;
+    __u32 size;
+    __u32 pos;
+    int err;
+} WireBuf;
+
+
+static inline void wire_put(WireBuf *b, const void *src, __u32 len)
+{
+    if (b->data)
+    {
+        if (b->pos + len > b->size)
+        {
+            b->err = 1;
+            return;
+        }
+        memcpy(b->data + b->pos, src, len);
+    }
+    b->pos += len;
+}
+
+static inline void wire_get(WireBuf *b, void *dst, __u32 len)
+{
+    if (b->err | (b->pos + len > b->size))
+    {
+        b->err = 1;
+        memset(dst, 0, len);
+        return;
+    }
+    memcpy(dst, b->data + b->pos, len);
+    b->pos += len;
+}
+
+static inline void wire_put_u8(WireBuf *b, __u8 v)
+{
+    wire_put(b, &v, 1);
+}
+
+static inline void wire_put_u16(WireBuf *b, __u16 v)
+{
+    __u8 bytes[2] = { v, v >> 8 };
+    wire_put(b, bytes, 2);
+}
+
+static inline void wire_put_u32(WireBuf *b, __u32 v)
+{
+    __u8 bytes[4] = { v, v >> 8, v >> 16, v >> 24 };
+    wire_put(b, bytes, 4);
+}
+
+static inline void wire_put_u64(WireBuf *b, __u64 v)
+{
+    wire_put_u32(b, (__u32) v);
+    wire_put_u32(b, (__u32) (v >> 32));
+}
+
+static inline __u8 wire_get_u8(WireBuf *b)
+{
+    __u8 v;
+    wire_get(b, &v, 1);
+    return v;
+}
+
+static inline __u16 wire_get_u16(WireBuf *b)
+{
+    __u8 bytes[2];
+    wire_get(b, bytes, 2);
+    return bytes[0] | ((__u16) bytes[1] << 8);
+}
+
+static inline __u32 wire_get_u32(WireBuf *b)
+{
+    __u8 bytes[4];
+    wire_get(b, bytes, 4);
+    return bytes[0] | ((__u32) bytes[1] << 8) | ((__u32) bytes[2] << 16) | ((__u32) bytes[3] << 24);
+}
+
+static inline __u64 wire_get_u64(WireBuf *b)
+{
+    __u64 low = wire_get_u32(b);
+    return low | ((__u64) wire_get_u32(b) << 32);
+}
+
+static inline void wire_put_name(WireBuf *b, const char *name)
+{
+    __u16 len = strnlen(name, MAX_NAME_SIZE - 1);
+    wire_put_u16(b, len);
+    wire_put(b, name, len);
+}
+
+static inline void wire_get_name(WireBuf *b, char *name)
+{
+    __u16 len = wire_get_u16(b);
+    if (len >= MAX_NAME_SIZE)
+    {
+        b->err = 1;
+        len = 0;
+    }
+    wire_get(b, name, len);
+    name[len] = 0;
+}
+
+static inline void wire_put_handle(WireBuf *b, const Handle *handle)
+{
+    __u8 len = handle->length <= MAX_HANDLE_SIZE ? handle->length : 0;
+    wire_put_u8(b, len);
+    if (len == 0)
+        return;
+    wire_put_u32(b, handle->type);
+    wire_put(b, handle->bytes, len);
+}
+
+static inline void wire_get_handle(WireBuf *b, Handle *handle)
+{
+    handle->length = wire_get_u8(b);
+    handle->type = 0;
+    if (handle->length > MAX_HANDLE_SIZE)
+    {
+        b->err = 1;
+        handle->length = 0;
+    }
+    if (handle->length == 0)
+        return;
+    handle->type = wire_get_u32(b);
+    wire_get(b, handle->bytes, handle->length);
+}
+
+static inline void wire_put_info(WireBuf *b, const ObjectInfo *info)
+{
+    wire_put_u8(b, info->type);
+    wire_put_u64(b, info->inode_n);
+    wire_put_handle(b, &info->handle);
+}
+
+static inline void wire_get_info(WireBuf *b, ObjectInfo *info)
+{
+    info->type = wire_get_u8(b);
+    info->inode_n = wire_get_u64(b);
+    wire_get_handle(b, &info->handle);
+}
+
+
+static inline void wire_put_attrs(WireBuf *b, const ObjectAttrs *attrs)
+{
+    wire_put_u64(b, attrs->size);
+    wire_put_u64(b, (__u64) attrs->mtime_sec);
+    wire_put_u32(b, attrs->mtime_nsec);
+    wire_put_u32(b, attrs->nlink);
+}
+
+static inline void wire_get_attrs(WireBuf *b, ObjectAttrs *attrs)
+{
+    attrs->size = wire_get_u64(b);
+    attrs->mtime_sec = (__s64) wire_get_u64(b);
+    attrs->mtime_nsec = wire_get_u32(b);
+    attrs->nlink = wire_get_u32(b);
+}
+
+// encoded size of a LIST entry, lets the server stop before it exceeds max_bytes
+static inline __u32 wire_object_size(const Object *obj, int plus)
+{
+    WireBuf b = { 0 };
+    wire_put_info(&b, &obj->info);
+    wire_put_u64(&b, obj->cookie);
+    wire_put_name(&b, obj->name);
+    if (plus)
+        wire_put_attrs(&b, &obj->attrs);
+    return b.pos;
+}
+
+
+static inline void wire_put_header(__u8 *buf, const WireHeader *hdr)
+{
+    WireBuf b = { .data = buf, .size = WIRE_HEADER_SIZE };
+    wire_put_u32(&b, hdr->body_length);
+    wire_put_u32(&b, hdr->data_length);
+    wire_put_u16(&b, hdr->type);
+    wire_put_u16(&b, hdr->status);
+    wire_put_u32(&b, hdr->xid);
+}
+
+// returns -1 if the announced sizes are out of bounds
+static inline int wire_get_header(const __u8 *buf, WireHeader *hdr)
+{
+    WireBuf b = { .data = (__u8 *) buf, .size = WIRE_HEADER_SIZE };
+    hdr->body_length = wire_get_u32(&b);
+    hdr->data_length = wire_get_u32(&b);
+    hdr->type = wire_get_u16(&b);
+    hdr->status = wire_get_u16(&b);
+    hdr->xid = wire_get_u32(&b);
+    return ((hdr->body_length > WIRE_MAX_BODY_SIZE) | (hdr->data_length > MAX_DATA_LENGTH)) ? -1 : 0;
+}
+
+
+static inline void wire_put_create_request(WireBuf *b, const CreateRequest *req)
+{
+    wire_put_u8(b, req->type);
+    wire_put_u64(b, req->parent_inode_n);
+    wire_put_handle(b, &req->parent_handle);
+    wire_put_name(b, req->name);
+}
+
+static inline void wire_get_create_request(WireBuf *b, CreateRequest *req)
+{
+    req->type = wire_get_u8(b);
+    req->parent_inode_n = wire_get_u64(b);
+    wire_get_handle(b, &req->parent_handle);
+    wire_get_name(b, req->name);
+}
+
+static inline void wire_put_link_request(WireBuf *b, const LinkRequest *req)
+{
+    wire_put_u64(b, req->source_inode_n);
+    wire_put_handle(b, &req->source_handle);
+    wire_put_u64(b, req->parent_inode_n);
+    wire_put_handle(b, &req->parent_handle);
+    wire_put_name(b, req->name);
+}
+
+static inline void wire_get_link_request(WireBuf *b, LinkRequest *req)
+{
+    req->source_inode_n = wire_get_u64(b);
+    wire_get_handle(b, &req->source_handle);
+    req->parent_inode_n = wire_get_u64(b);
+    wire_get_handle(b, &req->parent_handle);
+    wire_get_name(b, req->name);
+}
+
+// UNLINK, RMDIR and LOOKUP all name an entry of a directory
+static inline void wire_put_entry_request(WireBuf *b, __u64 parent_inode_n, const Handle *parent_handle, const char *name)
+{
+    wire_put_u64(b, parent_inode_n);
+    wire_put_handle(b, parent_handle);
+    wire_put_name(b, name);
+}
+
+static inline void wire_get_entry_request(WireBuf *b, __u64 *parent_inode_n, Handle *parent_handle, char *name)
+{
+    *parent_inode_n = wire_get_u64(b);
+    wire_get_handle(b, parent_handle);
+    wire_get_name(b, name);
+}
+
+static inline void wire_put_read_request(WireBuf *b, const ReadRequest *req)
+{
+    wire_put_u64(b, req->inode_n);
+    wire_put_handle(b, &req->handle);
+    wire_put_u64(b, req->offset);
+    wire_put_u32(b, req->length);
+}
+
+static inline void wire_get_read_request(WireBuf *b, ReadRequest *req)
+{
+    req->inode_n = wire_get_u64(b);
+    wire_get_handle(b, &req->handle);
+    req->offset = wire_get_u64(b);
+    req->length = wire_get_u32(b);
+}
+
+// the length of a WRITE is the data length of the message
+static inline void wire_put_write_request(WireBuf *b, const WriteRequest *req)
+{
+    wire_put_u64(b, req->inode_n);
+    wire_put_handle(b, &req->handle);
+    wire_put_u64(b, req->offset);
+}
+
+static inline void wire_get_write_request(WireBuf *b, WriteRequest *req)
+{
+    req->inode_n = wire_get_u64(b);
+    wire_get_handle(b, &req->handle);
+    req->offset = wire_get_u64(b);
+}
+
+static inline void wire_put_compound_request(WireBuf *b, const CompoundRequest *req)
+{
+    if (req->count > MAX_COMPOUND_OPS)
+    {
+        b->err = 1;
+        return;
+    }
+    wire_put_u8(b, req->count);
+    for (__u32 i = 0; i < req->count; i++)
+    {
+        const CompoundOpRequest *op = &req->ops[i];
+        wire_put_u16(b, op->type);
+        switch (op->type)
+        {
+            case METHOD_TYPE_CREATE:
+                wire_put_create_request(b, &op->create);
+                break;
+            case METHOD_TYPE_LINK:
+                wire_put_link_request(b, &op->link);
+                break;
+            case METHOD_TYPE_UNLINK:
+                wire_put_entry_request(b, op->unlink.parent_inode_n, &op->unlink.parent_handle, op->unlink.name);
+                break;
+            case METHOD_TYPE_READ:
+                wire_put_read_request(b, &op->read);
+                break;
+            case METHOD_TYPE_WRITE:
+                wire_put_write_request(b, &op->write);
+                wire_put_u32(b, op->write.length);
+                break;
+            case METHOD_TYPE_RMDIR:
+                wire_put_entry_request(b, op->rmdir.parent_inode_n, &op->rmdir.parent_handle, op->rmdir.name);
+                break;
+            case METHOD_TYPE_LOOKUP:
+                wire_put_entry_request(b, op->lookup.parent_inode_n, &op->lookup.parent_handle, op->lookup.name);
+                break;
+            default:
+                b->err = 1;
+        }
+    }
+}
+
+static inline void wire_get_compound_request(WireBuf *b, CompoundRequest *req)
+{
+    req->count = wire_get_u8(b);
+    if (req->count > MAX_COMPOUND_OPS)
+    {
+        b->err = 1;
+        req->count = 0;
+    }
+    for (__u32 i = 0; (i < req->count) & !b->err; i++)
+    {
+        CompoundOpRequest *op = &req->ops[i];
+        op->type = wire_get_u16(b);
+        switch (op->type)
+        {
+            case METHOD_TYPE_CREATE:
+                wire_get_create_request(b, &op->create);
+                break;
+            case METHOD_TYPE_LINK:
+                wire_get_link_request(b, &op->link);
+                break;
+            case METHOD_TYPE_UNLINK:
+                wire_get_entry_request(b, &op->unlink.parent_inode_n, &op->unlink.parent_handle, op->unlink.name);
+                break;
+            case METHOD_TYPE_READ:
+                wire_get_read_request(b, &op->read);
+                break;
+            case METHOD_TYPE_WRITE:
+                wire_get_write_request(b, &op->write);
+                op->write.length = wire_get_u32(b);
+                if (op->write.length > MAX_DATA_LENGTH)
+                    b->err = 1;
+                break;
+            case METHOD_TYPE_RMDIR:
+                wire_get_entry_request(b, &op->rmdir.parent_inode_n, &op->rmdir.parent_handle, op->rmdir.name);
+                break;
+            case METHOD_TYPE_LOOKUP:
+                wire_get_entry_request(b, &op->lookup.parent_inode_n, &op->lookup.parent_handle, op->lookup.name);
+                break;
+            default:
+                b->err = 1;
+        }
+    }
+}
+
+static inline void wire_put_latency(WireBuf *b, const LatencySummary *latency)
+{
+    wire_put_u64(b, latency->p50);
+    wire_put_u64(b, latency->p99);
+    wire_put_u64(b, latency->p999);
+    wire_put_u64(b, latency->max);
+}
+
+static inline void wire_get_latency(WireBuf *b, LatencySummary *latency)
+{
+    latency->p50 = wire_get_u64(b);
+    latency->p99 = wire_get_u64(b);
+    latency->p999 = wire_get_u64(b);
+    latency->max = wire_get_u64(b);
+}
+
+static inline void wire_put_stats_response(WireBuf *b, const StatsResponse *resp)
+{
+    wire_put_u64(b, resp->uptime_ns);
+    wire_put_u8(b, STATS_RESOLVE_PATHS_COUNT);
+    for (__u32 i = 0; i < STATS_RESOLVE_PATHS_COUNT; i++)
+        wire_put_u64(b, resp->resolve_paths[i]);
+    wire_put_u8(b, STATS_MAX_METHODS);
+    for (__u32 i = 0; i < STATS_MAX_METHODS; i++)
+    {
+        const MethodStats *method = &resp->methods[i];
+        wire_put_u64(b, method->count);
+        wire_put_u64(b, method->errors);
+        wire_put_u64(b, method->bytes);
+        wire_put_latency(b, &method->total);
+        wire_put_latency(b, &method->resolve);
+        wire_put_latency(b, &method->syscall);
+    }
+}
+
+static inline void wire_get_stats_response(WireBuf *b, StatsResponse *resp)
+{
+    resp->uptime_ns = wire_get_u64(b);
+    if (wire_get_u8(b) != STATS_RESOLVE_PATHS_COUNT)
+    {
+        b->err = 1;
+        return;
+    }
+    for (__u32 i = 0; i < STATS_RESOLVE_PATHS_COUNT; i++)
+        resp->resolve_paths[i] = wire_get_u64(b);
+    if (wire_get_u8(b) != STATS_MAX_METHODS)
+    {
+        b->err = 1;
+        return;
+    }
+    for (__u32 i = 0; i < STATS_MAX_METHODS; i++)
+    {
+        MethodStats *method = &resp->methods[i];
+        method->count = wire_get_u64(b);
+        method->errors = wire_get_u64(b);
+        method->bytes = wire_get_u64(b);
+        wire_get_latency(b, &method->total);
+        wire_get_latency(b, &method->resolve);
+        wire_get_latency(b, &method->syscall);
+    }
+}
+
+static inline void wire_put_request_body(WireBuf *b, const MethodRequest *req)
+{
+    switch (req->type)
+    {
+        case METHOD_TYPE_CREATE:
+            wire_put_create_request(b, &req->create);
+            break;
+        case METHOD_TYPE_LINK:
+            wire_put_link_request(b, &req->link);
+            break;
+        case METHOD_TYPE_UNLINK:
+            wire_put_entry_request(b, req->unlink.parent_inode_n, &req->unlink.parent_handle, req->unlink.name);
+            break;
+        case METHOD_TYPE_READ:
+            wire_put_read_request(b, &req->read);
+            break;
+        case METHOD_TYPE_WRITE:
+            wire_put_write_request(b, &req->write);
+            break;
+        case METHOD_TYPE_LIST:
+            wire_put_u64(b, req->list.inode_n);
+            wire_put_handle(b, &req->list.handle);
+            wire_put_u64(b, req->list.cookie);
+            wire_put_u32(b, req->list.max_bytes);
+            wire_put_u8(b, req->list.plus);
+            break;
+        case METHOD_TYPE_RMDIR:
+            wire_put_entry_request(b, req->rmdir.parent_inode_n, &req->rmdir.parent_handle, req->rmdir.name);
+            break;
+        case METHOD_TYPE_LOOKUP:
+            wire_put_entry_request(b, req->lookup.parent_inode_n, &req->lookup.parent_handle, req->lookup.name);
+            break;
+        case METHOD_TYPE_MOUNT:
+            wire_put_u32(b, req->mount.rsize);
+            wire_put_u32(b, req->mount.wsize);
+            break;
+        case METHOD_TYPE_COMPOUND:
+            wire_put_compound_request(b, &req->compound);
+            break;
+        case METHOD_TYPE_STATS:
+            break;
+        case METHOD_TYPE_GETATTR:
+            wire_put_u64(b, req->getattr.inode_n);
+            wire_put_handle(b, &req->getattr.handle);
+            break;
+        default:
+            b->err = 1;
+    }
+}
+
+static inline void wire_get_request_body(WireBuf *b, MethodRequest *req)
+{
+    switch (req->type)
+    {
+        case METHOD_TYPE_CREATE:
+            wire_get_create_request(b, &req->create);
+            break;
+        case METHOD_TYPE_LINK:
+            wire_get_link_request(b, &req->link);
+            break;
+        case METHOD_TYPE_UNLINK:
+            wire_get_entry_request(b, &req->unlink.parent_inode_n, &req->unlink.parent_handle, req->unlink.name);
+            break;
+        case METHOD_TYPE_READ:
+            wire_get_read_request(b, &req->read);
+            break;
+        case METHOD_TYPE_WRITE:
+            wire_get_write_request(b, &req->write);
+            break;
+        case METHOD_TYPE_LIST:
+            req->list.inode_n = wire_get_u64(b);
+            wire_get_handle(b, &req->list.handle);
+            req->list.cookie = wire_get_u64(b);
+            req->list.max_bytes = wire_get_u32(b);
+            req->list.plus = wire_get_u8(b);
+            break;
+        case METHOD_TYPE_RMDIR:
+            wire_get_entry_request(b, &req->rmdir.parent_inode_n, &req->rmdir.parent_handle, req->rmdir.name);
+            break;
+        case METHOD_TYPE_LOOKUP:
+            wire_get_entry_request(b, &req->lookup.parent_inode_n, &req->lookup.parent_handle, req->lookup.name);
+            break;
+        case METHOD_TYPE_MOUNT:
+            req->mount.rsize = wire_get_u32(b);
+            req->mount.wsize = wire_get_u32(b);
+            break;
+        case METHOD_TYPE_COMPOUND:
+            wire_get_compound_request(b, &req->compound);
+            break;
+        case METHOD_TYPE_STATS:
+            break;
+        case METHOD_TYPE_GETATTR:
+            req->getattr.inode_n = wire_get_u64(b);
+            wire_get_handle(b, &req->getattr.handle);
+            break;
+        default:
+            b->err = 1;
+    }
+}
+
+static inline void wire_put_lookup_response(WireBuf *b, const LookupResponse *resp)
+{
+    wire_put_info(b, &resp->info);
+    wire_put_attrs(b, &resp->attrs);
+}
+
+static inline void wire_get_lookup_response(WireBuf *b, LookupResponse *resp)
+{
+    wire_get_info(b, &resp->info);
+    wire_get_attrs(b, &resp->attrs);
+}
+
+// every op that ran reports its status, successful ones their results as well
+static inline void wire_put_compound_response(WireBuf *b, const CompoundResponse *resp)
+{
+    if (resp->count > MAX_COMPOUND_OPS)
+    {
+        b->err = 1;
+        return;
+    }
+    wire_put_u8(b, resp->count);
+    for (__u32 i = 0; i < resp->count; i++)
+    {
+        const CompoundOpResponse *op = &resp->ops[i];
+        wire_put_u16(b, op->type);
+        wire_put_u8(b, op->status);
+        if (op->status != METHOD_STATUS_OK)
+            continue;
+        switch (op->type)
+        {
+            case METHOD_TYPE_CREATE:
+                wire_put_u64(b, op->create.inode_n);
+                wire_put_handle(b, &op->create.handle);
+                break;
+            case METHOD_TYPE_UNLINK:
+                wire_put_u32(b, op->unlink.nlink);
+                break;
+            case METHOD_TYPE_READ:
+                wire_put_u32(b, op->read.length);
+                break;
+            case METHOD_TYPE_WRITE:
+                wire_put_u32(b, op->write.length);
+                wire_put_attrs(b, &op->write.attrs);
+                break;
+            case METHOD_TYPE_LOOKUP:
+                wire_put_lookup_response(b, &op->lookup);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static inline void wire_get_compound_response(WireBuf *b, CompoundResponse *resp)
+{
+    resp->count = wire_get_u8(b);
+    if (resp->count > MAX_COMPOUND_OPS)
+    {
+        b->err = 1;
+        resp->count = 0;
+    }
+    for (__u32 i = 0; (i < resp->count) & !b->err; i++)
+    {
+        CompoundOpResponse *op = &resp->ops[i];
+        op->type = wire_get_u16(b);
+        op->status = wire_get_u8(b);
+        if (op->status != METHOD_STATUS_OK)
+            continue;
+        switch (op->type)
+        {
+            case METHOD_TYPE_CREATE:
+                op->create.inode_n = wire_get_u64(b);
+                wire_get_handle(b, &op->create.handle);
+                break;
+            case METHOD_TYPE_UNLINK:
+                op->unlink.nlink = wire_get_u32(b);
+                break;
+            case METHOD_TYPE_READ:
+                op->read.length = wire_get_u32(b);
+                if (op->read.length > MAX_DATA_LENGTH)
+                    b->err = 1;
+                break;
+            case METHOD_TYPE_WRITE:
+                op->write.length = wire_get_u32(b);
+                wire_get_attrs(b, &op->write.attrs);
+                break;
+            case METHOD_TYPE_LOOKUP:
+                wire_get_lookup_response(b, &op->lookup);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static inline void wire_put_response_body(WireBuf *b, const MethodResponse *resp)
+{
+    if (resp->type == METHOD_TYPE_COMPOUND)
+    {
+        wire_put_compound_response(b, &resp->compound);
+        return;
+    }
+    if (resp->status != METHOD_STATUS_OK)
+        return;
+
+    switch (resp->type)
+    {
+        case METHOD_TYPE_CREATE:
+            wire_put_u64(b, resp->create.inode_n);
+            wire_put_handle(b, &resp->create.handle);
+            break;
+        case METHOD_TYPE_UNLINK:
+            wire_put_u32(b, resp->unlink.nlink);
+            break;
+        case METHOD_TYPE_WRITE:
+            wire_put_u32(b, resp->write.length);
+            wire_put_attrs(b, &resp->write.attrs);
+            break;
+        case METHOD_TYPE_LIST:
+            wire_put_u8(b, resp->list.eof);
+            wire_put_u8(b, resp->list.plus);
+            wire_put_u32(b, resp->list.objects.count);
+            for (__u32 i = 0; i < resp->list.objects.count; i++)
+            {
+                const Object *obj = &resp->list.objects.objects[i];
+                wire_put_info(b, &obj->info);
+                wire_put_u64(b, obj->cookie);
+                wire_put_name(b, obj->name);
+                if (resp->list.plus)
+                    wire_put_attrs(b, &obj->attrs);
+            }
+            break;
+        case METHOD_TYPE_LOOKUP:
+            wire_put_lookup_response(b, &resp->lookup);
+            break;
+        case METHOD_TYPE_MOUNT:
+            wire_put_u64(b, resp->mount.inode_n);
+            wire_put_handle(b, &resp->mount.handle);
+            wire_put_u32(b, resp->mount.rsize);
+            wire_put_u32(b, resp->mount.wsize);
+            break;
+        case METHOD_TYPE_STATS:
+            wire_put_stats_response(b, &resp->stats);
+            break;
+        case METHOD_TYPE_GETATTR:
+            wire_put_attrs(b, &resp->getattr.attrs);
+            break;
+        default:
+            break;
+    }
+}
+
+static inline void wire_get_response_body(WireBuf *b, MethodResponse *resp)
+{
+    if (resp->type == METHOD_TYPE_COMPOUND)
+    {
+        wire_get_compound_response(b, &resp->compound);
+        return;
+    }
+    if (resp->status != METHOD_STATUS_OK)
+        return;
+
+    switch (resp->type)
+    {
+        case METHOD_TYPE_CREATE:
+            resp->create.inode_n = wire_get_u64(b);
+            wire_get_handle(b, &resp->create.handle);
+            break;
+        case METHOD_TYPE_UNLINK:
+            resp->unlink.nlink = wire_get_u32(b);
+            break;
+        case METHOD_TYPE_WRITE:
+            resp->write.length = wire_get_u32(b);
+            wire_get_attrs(b, &resp->write.attrs);
+            break;
+        case METHOD_TYPE_LIST:
+            resp->list.eof = wire_get_u8(b);
+            resp->list.plus = wire_get_u8(b);
+            resp->list.objects.count = wire_get_u32(b);
+            if (resp->list.objects.count > MAX_OBJECTS_COUNT)
+            {
+                b->err = 1;
+                resp->list.objects.count = 0;
+            }
+            for (__u32 i = 0; i < resp->list.objects.count; i++)
+            {
+                Object *obj = &resp->list.objects.objects[i];
+                wire_get_info(b, &obj->info);
+                obj->cookie = wire_get_u64(b);
+                wire_get_name(b, obj->name);
+                if (resp->list.plus)
+                    wire_get_attrs(b, &obj->attrs);
+            }
+            break;
+        case METHOD_TYPE_LOOKUP:
+            wire_get_lookup_response(b, &resp->lookup);
+            break;
+        case METHOD_TYPE_MOUNT:
+            resp->mount.inode_n = wire_get_u64(b);
+            wire_get_handle(b, &resp->mount.handle);
+            resp->mount.rsize = wire_get_u32(b);
+            resp->mount.wsize = wire_get_u32(b);
+            break;
+        case METHOD_TYPE_STATS:
+            wire_get_stats_response(b, &resp->stats);
+            break;
+        case METHOD_TYPE_GETATTR:
+            wire_get_attrs(b, &resp->getattr.attrs);
+            break;
+        default:
+            break;
+    }
+}
+
+
+// encodes header and body into buf and returns their size, or -1 if they don't fit;
+// with buf == 0 only the size is computed. File data is sent separately after them.
+static inline int wire_encode_request(const MethodRequest *req, __u8 *buf, __u32 size)
+{
+    WireBuf b = { .data = buf, .size = size, .pos = WIRE_HEADER_SIZE };
+    wire_put_request_body(&b, req);
+    if (b.err | (b.pos - WIRE_HEADER_SIZE > WIRE_MAX_BODY_SIZE) | (method_request_data_length(req) > MAX_DATA_LENGTH))
+        return -1;
+
+    if (buf)
+    {
+        WireHeader hdr = { .body_length = b.pos - WIRE_HEADER_SIZE, .data_length = method_request_data_length(req), .type = req->type, .status = 0, .xid = req->xid };
+        wire_put_header(buf, &hdr);
+    }
+    return b.pos;
+}
+
+static inline int wire_encode_response(const MethodResponse *resp, __u8 *buf, __u32 size)
+{
+    WireBuf b = { .data = buf, .size = size, .pos = WIRE_HEADER_SIZE };
+    wire_put_response_body(&b, resp);
+    if (b.err | (b.pos - WIRE_HEADER_SIZE > WIRE_MAX_BODY_SIZE) | (method_response_data_length(resp) > MAX_DATA_LENGTH))
+        return -1;
+
+    if (buf)
+    {
+        WireHeader hdr = { .body_length = b.pos - WIRE_HEADER_SIZE, .data_length = method_response_data_length(resp), .type = resp->type, .status = resp->status, .xid = resp->xid };
+        wire_put_header(buf, &hdr);
+    }
+    return b.pos;
+}
+
+// body holds hdr->body_length bytes, returns -1 on malformed input
+static inline int wire_decode_request(const WireHeader *hdr, const __u8 *body, MethodRequest *req)
+{
+    WireBuf b = { .data = (__u8 *) body, .size = hdr->body_length };
+    memset(req, 0, sizeof(MethodRequest));
+    req->type = hdr->type;
+    req->xid = hdr->xid;
+    wire_get_request_body(&b, req);
+    if (req->type == METHOD_TYPE_WRITE)
+        req->write.length = hdr->data_length;
+    if (b.err | (b.pos != b.size) | (method_request_data_length(req) != hdr->data_length))
+        return -1;
+    return 0;
+}
+
+static inline int wire_decode_response(const WireHeader *hdr, const __u8 *body, MethodResponse *resp)
+{
+    WireBuf b = { .data = (__u8 *) body, .size = hdr->body_length };
+    memset(resp, 0, sizeof(MethodResponse));
+    resp->status = hdr->status;
+    resp->type = hdr->type;
+    resp->xid = hdr->xid;
+    wire_get_response_body(&b, resp);
+    if ((resp->type == METHOD_TYPE_READ) & (resp->status == METHOD_STATUS_OK))
+        resp->read.length = hdr->data_length;
+    if (b.err | (b.pos != b.size) | (method_response_data_length(resp) != hdr->data_length))
+        return -1;
+    return 0;
+}
+
+#endif
\ No newline at end of file